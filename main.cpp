@@ -12,6 +12,11 @@ int main() {
         8080, 3, 60000, false, /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "8410", "yourdb", /* Mysql配置 */
         12, 6, false, 1,
-        1024); /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        1024, /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        0, false, /* 子循环数量(0 为单 Reactor + 线程池) 最少连接分发 */
+        false,    /* 使用 io_uring 代替 epoll */
+        true,     /* EPOLLONESHOT，false 为连接归属模式 */
+        64, 1000, /* 静态文件缓存容量 (MB) 缓存校验间隔 (ms) */
+        nullptr, nullptr); /* TLS 证书链和私钥 (PEM)，为空时不启用 TLS */
     server.Start();
 }
@@ -0,0 +1,50 @@
+#include "arena.h"
+
+void Arena::Reset() {
+    if (!head_) {
+        return;
+    }
+    while (head_->next) {
+        Block *block = head_->next;
+        head_->next = block->next;
+        BlockPool::Free(reinterpret_cast<char *>(block), block->cap);
+    }
+    cur_ = reinterpret_cast<char *>(head_ + 1);
+}
+
+void Arena::Release() {
+    while (head_) {
+        Block *block = head_;
+        head_ = block->next;
+        BlockPool::Free(reinterpret_cast<char *>(block), block->cap);
+    }
+    cur_ = end_ = nullptr;
+}
+
+size_t Arena::Capacity() const {
+    size_t cap = 0;
+    for (Block *block = head_; block; block = block->next) {
+        cap += block->cap;
+    }
+    return cap;
+}
+
+// 当前块放不下时取一块新的，之前的块留在链表中直到 Reset
+void *Arena::Grow(size_t bytes, size_t align) {
+    size_t size = FIRST_BLOCK;
+    if (head_) {
+        size = head_->cap * 2;
+    }
+    size_t need = sizeof(Block) + bytes + align;
+    if (size < need) {
+        size = need;
+    }
+    size_t cap;
+    Block *block = reinterpret_cast<Block *>(BlockPool::Alloc(size, &cap));
+    block->next = head_;
+    block->cap = cap;
+    head_ = block;
+    cur_ = reinterpret_cast<char *>(block + 1);
+    end_ = reinterpret_cast<char *>(block) + cap;
+    return do_allocate(bytes, align);
+}
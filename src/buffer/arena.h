@@ -0,0 +1,61 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "blockpool.h"
+#include <memory_resource>
+#include <stddef.h>
+#include <stdint.h>
+
+// 请求级的内存区，作为 std::pmr 容器的 memory_resource 使用
+// 分配只是在当前块中移动指针，单独的释放不做任何事，请求结束时 Reset
+// 一次性回收；块从 BlockPool 取得，用完一块后取一块至少两倍大的
+// 使用者必须保证 Reset 之后不再访问之前分配的内存，
+// 容器要先换成空的 (swap) 再 Reset
+// 只由一个线程使用
+class Arena : public std::pmr::memory_resource {
+  public:
+    // 第一块的大小，放得下常见请求的头部表和路径
+    static const size_t FIRST_BLOCK = 4096;
+
+    Arena() : head_(nullptr), cur_(nullptr), end_(nullptr) {}
+    ~Arena() { Release(); }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // 回收所有分配，保留最近的一块给下一个请求，其余的归还 BlockPool
+    void Reset();
+    // 回收所有分配并把块都归还 BlockPool
+    void Release();
+    // 持有的块的总大小
+    size_t Capacity() const;
+
+  private:
+    // 块的开头，最近取得的块在链表最前
+    struct alignas(alignof(max_align_t)) Block {
+        Block *next;
+        size_t cap;
+    };
+
+    void *do_allocate(size_t bytes, size_t align) override {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) &
+                      ~static_cast<uintptr_t>(align - 1);
+        uintptr_t end = reinterpret_cast<uintptr_t>(end_);
+        if (head_ && p <= end && bytes <= end - p) {
+            cur_ = reinterpret_cast<char *>(p + bytes);
+            return reinterpret_cast<void *>(p);
+        }
+        return Grow(bytes, align);
+    }
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(
+        const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+    void *Grow(size_t bytes, size_t align);
+
+    Block *head_;
+    char *cur_; // 当前块中下一个可分配的位置
+    char *end_;
+};
+
+#endif //__ARENA_H__
@@ -0,0 +1,90 @@
+#include "blockpool.h"
+#include <assert.h>
+#include <new>
+
+// 没有析构函数，线程退出时池析构之后仍可访问
+static thread_local bool pool_destroyed = false;
+
+BlockPool::BlockPool() : spill_(nullptr) {
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        free_[i] = nullptr;
+        cached_[i] = 0;
+    }
+}
+
+BlockPool::~BlockPool() {
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        while (free_[i]) {
+            FreeBlock *block = free_[i];
+            free_[i] = block->next;
+            ::operator delete(block);
+        }
+    }
+    ::operator delete(spill_);
+    pool_destroyed = true;
+}
+
+// 线程退出时，析构较晚的对象还可能归还块
+BlockPool *BlockPool::Local() {
+    if (pool_destroyed) {
+        return nullptr;
+    }
+    static thread_local BlockPool pool;
+    return &pool;
+}
+
+int BlockPool::ClassOf(size_t size) {
+    int cls = 0;
+    while (cls < CLASS_COUNT && (BLOCK_SIZE << cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+char *BlockPool::Alloc(size_t size, size_t *cap) {
+    int cls = ClassOf(size);
+    if (cls == CLASS_COUNT) {
+        *cap = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        return static_cast<char *>(::operator new(*cap));
+    }
+    *cap = BLOCK_SIZE << cls;
+    BlockPool *pool = Local();
+    if (pool && pool->free_[cls]) {
+        FreeBlock *block = pool->free_[cls];
+        pool->free_[cls] = block->next;
+        pool->cached_[cls]--;
+        return reinterpret_cast<char *>(block);
+    }
+    return static_cast<char *>(::operator new(*cap));
+}
+
+void BlockPool::Free(char *block, size_t cap) {
+    if (!block) {
+        return;
+    }
+    int cls = ClassOf(cap);
+    BlockPool *pool = Local();
+    if (pool && cls < CLASS_COUNT && (BLOCK_SIZE << cls) == cap) {
+        size_t limit = MAX_CACHED_BYTES / cap;
+        if (limit < MIN_CACHED) {
+            limit = MIN_CACHED;
+        }
+        if (pool->cached_[cls] < limit) {
+            FreeBlock *node = reinterpret_cast<FreeBlock *>(block);
+            node->next = pool->free_[cls];
+            pool->free_[cls] = node;
+            pool->cached_[cls]++;
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+char *BlockPool::Spill() {
+    BlockPool *pool = Local();
+    assert(pool);
+    if (!pool->spill_) {
+        pool->spill_ = static_cast<char *>(::operator new(SPILL_SIZE));
+    }
+    return pool->spill_;
+}
@@ -0,0 +1,46 @@
+#ifndef __BLOCKPOOL_H__
+#define __BLOCKPOOL_H__
+
+#include <stddef.h>
+
+// 每个线程一个的内存块池，连接缓冲区的存储都从这里取得
+// 块的大小为 BLOCK_SIZE 的 2 的幂倍，每个大小等级一个空闲链表，
+// 取得和归还都只是链表操作，内存不做清零
+// 块可以在一个线程取得、在另一个线程归还 (线程池模式下连接在工作线程间
+// 转移)，这时它进入归还线程的池中；每个等级缓存的字节数有上限，
+// 超过上限和超过最大等级的块直接释放
+class BlockPool {
+  public:
+    static const size_t BLOCK_SIZE = 1024;
+    // 1KB ~ 512KB
+    static const int CLASS_COUNT = 10;
+    // 每个等级最多缓存的字节数，最大的等级也至少缓存 MIN_CACHED 块
+    static const size_t MAX_CACHED_BYTES = 1024 * 1024;
+    static const size_t MIN_CACHED = 4;
+    // 溢出区的大小
+    static const size_t SPILL_SIZE = 64 * 1024;
+
+    // 取得至少 size 字节的块，*cap 为块的实际大小，归还时原样传回
+    static char *Alloc(size_t size, size_t *cap);
+    static void Free(char *block, size_t cap);
+    // 本线程的溢出区，读 socket 时接收缓冲区放不下的数据，
+    // 只在一次调用内使用，第一次使用时分配
+    static char *Spill();
+
+  private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    BlockPool();
+    ~BlockPool();
+    // 线程退出、池已析构时返回 nullptr
+    static BlockPool *Local();
+    static int ClassOf(size_t size);
+
+    FreeBlock *free_[CLASS_COUNT];
+    size_t cached_[CLASS_COUNT]; // 各等级缓存的块数
+    char *spill_;
+};
+
+#endif //__BLOCKPOOL_H__
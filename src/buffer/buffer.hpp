@@ -0,0 +1,218 @@
+#ifndef __BUFFER_HPP__
+#define __BUFFER_HPP__
+
+#include "blockpool.h"
+#include "chainbuffer.h"
+#include "scan.h"
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstring>
+#include <errno.h>
+#include <new>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// 增长策略：提供缓冲区的存储，Alloc 返回至少 size 字节的存储，
+// *cap 为实际大小，Free 时原样传回
+// 从 BlockPool 取得 2 的幂大小的块，不清零，适合连接的读写缓冲区
+struct PoolGrowth {
+    static char *Alloc(size_t size, size_t *cap) {
+        return BlockPool::Alloc(size, cap);
+    }
+    static void Free(char *data, size_t cap) { BlockPool::Free(data, cap); }
+};
+
+// 直接在堆上分配，不经过线程的块池，适合析构时机不受控制的单例
+struct HeapGrowth {
+    static char *Alloc(size_t size, size_t *cap) {
+        *cap = size;
+        return static_cast<char *>(::operator new(size));
+    }
+    static void Free(char *data, size_t) { ::operator delete(data); }
+};
+
+// 对象内的小块存储，N 为 0 时不占空间 (空基类)
+template <size_t N> struct BufferInline {
+    char *InlineData() { return inline_; }
+    char inline_[N];
+};
+template <> struct BufferInline<0> {
+    char *InlineData() { return nullptr; }
+};
+
+// 连续的缓冲区，可读区域总是连续的，日志用它拼接一行后整体取出
+// Cursor 为读写位置的类型：只由一个线程 (或在锁内) 使用时为 size_t，
+// 不加锁跨线程读写位置时为 std::atomic<size_t>
+// INLINE_SIZE 不为 0 时先使用对象内的存储，超出后才由 Growth 分配
+// 数据读完时读写位置回到开头，空间不够时先把未读数据移到开头，
+// 仍不够时按至少翻倍换成更大的存储，只拷贝未读的数据，不做清零
+// 没有内联存储时，初始大小为 0 或 Release 之后不持有存储，第一次写入时再分配
+template <class Cursor, size_t INLINE_SIZE, class Growth>
+class BasicBuffer : private BufferInline<INLINE_SIZE> {
+  public:
+    explicit BasicBuffer(size_t init_buff_size = 1024)
+        : read_pos_(0), write_pos_(0) {
+        if (init_buff_size <= INLINE_SIZE) {
+            data_ = this->InlineData();
+            cap_ = INLINE_SIZE;
+        } else {
+            data_ = Growth::Alloc(init_buff_size, &cap_);
+        }
+    }
+    ~BasicBuffer() { Release(); }
+    BasicBuffer(const BasicBuffer &) = delete;
+    BasicBuffer &operator=(const BasicBuffer &) = delete;
+
+    size_t WriteableBytes() const { return cap_ - write_pos_; }
+    size_t ReadableBytes() const { return write_pos_ - read_pos_; }
+    size_t PrependableBytes() const { return read_pos_; }
+    // 持有的存储大小，包括内联存储
+    size_t Capacity() const { return cap_; }
+    const char *Peek() const { return data_ + read_pos_; }
+    char *BeginRead() { return data_ + read_pos_; }
+    const char *BeginWriteConst() const { return data_ + write_pos_; }
+    char *BeginWrite() { return data_ + write_pos_; }
+
+    void EnsureWriteable(size_t len) {
+        if (WriteableBytes() < len) {
+            MakeSpace(len);
+        }
+        assert(WriteableBytes() >= len);
+    }
+    void HashWritten(size_t len) { write_pos_ += len; }
+
+    void Retrieve(size_t len) {
+        assert(len <= ReadableBytes());
+        read_pos_ += len;
+        if (read_pos_ == write_pos_) {
+            // 读完时回到开头，之后的数据不需要移动
+            read_pos_ = 0;
+            write_pos_ = 0;
+        }
+    }
+    void RetrieveUntil(const char *end) {
+        assert(Peek() <= end);
+        Retrieve(end - Peek());
+    }
+    void RetrieveAll() {
+        read_pos_ = 0;
+        write_pos_ = 0;
+    }
+    // 丢弃所有数据，把存储交还给 Growth (有内联存储时回到内联存储)
+    void Release() {
+        if (data_ != this->InlineData()) {
+            Growth::Free(data_, cap_);
+            data_ = this->InlineData();
+            cap_ = INLINE_SIZE;
+        }
+        read_pos_ = 0;
+        write_pos_ = 0;
+    }
+    std::string RetrieveAllToStr() {
+        std::string str(Peek(), ReadableBytes());
+        RetrieveAll();
+        return str;
+    }
+
+    // 删除可读区域中 [offset, offset + len) 的数据，后面的数据前移
+    void Erase(size_t offset, size_t len) {
+        assert(offset + len <= ReadableBytes());
+        if (len == 0) {
+            return;
+        }
+        char *begin = BeginRead() + offset;
+        memmove(begin, begin + len, BeginWrite() - begin - len);
+        write_pos_ -= len;
+    }
+
+    // 在可读区域中查找 "\r\n"，返回 '\r' 的位置，找不到返回 nullptr
+    const char *FindCRLF() const { return FindCRLF(Peek()); }
+    const char *FindCRLF(const char *start) const {
+        assert(Peek() <= start && start <= BeginWriteConst());
+        const char *crlf = Scan::FindCRLF(start, BeginWriteConst());
+        return crlf == BeginWriteConst() ? nullptr : crlf;
+    }
+
+    void Append(std::string_view str) { Append(str.data(), str.size()); }
+    void Append(const void *data, size_t len) {
+        assert(data);
+        Append(static_cast<const char *>(data), len);
+    }
+    void Append(const char *str, size_t len) {
+        assert(str);
+        EnsureWriteable(len);
+        memcpy(BeginWrite(), str, len);
+        HashWritten(len);
+    }
+    void Append(const BasicBuffer &buff) {
+        Append(buff.Peek(), buff.ReadableBytes());
+    }
+
+    // 剩余空间之后再读入线程的溢出区，多出的数据再并入缓冲区
+    ssize_t ReadFd(int fd, int *Errno) {
+        struct iovec iov[2];
+        const size_t writeable = WriteableBytes();
+        iov[0].iov_base = BeginWrite();
+        iov[0].iov_len = writeable;
+        iov[1].iov_base = BlockPool::Spill();
+        iov[1].iov_len = BlockPool::SPILL_SIZE;
+
+        // readv 函数会将 fd 的所有内容写入到 iov 中，返回实际写入的 iov
+        // 中的字数。与 readv 相对的还有一个 writev ，这个函数是将 iov
+        // 中的内容写入到 fd 中去，返回写入 fd 的字数
+        const ssize_t len = readv(fd, iov, 2);
+        if (len < 0) {
+            *Errno = errno;
+        } else if (static_cast<size_t>(len) <= writeable) {
+            write_pos_ += len;
+        } else {
+            write_pos_ = cap_;
+            Append(static_cast<const char *>(iov[1].iov_base),
+                   len - writeable);
+        }
+        return len;
+    }
+    // 将内容写入 fd
+    ssize_t WriteFd(int fd, int *Errno) {
+        ssize_t len = write(fd, Peek(), ReadableBytes());
+        if (len < 0) {
+            *Errno = errno;
+            return len;
+        }
+        Retrieve(len);
+        return len;
+    }
+
+  private:
+    void MakeSpace(size_t len) {
+        size_t readable = ReadableBytes();
+        if (WriteableBytes() + PrependableBytes() >= len) {
+            memmove(data_, data_ + read_pos_, readable);
+        } else {
+            size_t cap;
+            char *data = Growth::Alloc(std::max(readable + len, cap_ * 2),
+                                       &cap);
+            if (readable > 0) {
+                memcpy(data, data_ + read_pos_, readable);
+            }
+            Release();
+            data_ = data;
+            cap_ = cap;
+        }
+        read_pos_ = 0;
+        write_pos_ = readable;
+    }
+
+    char *data_;
+    size_t cap_;
+    Cursor read_pos_;
+    Cursor write_pos_;
+};
+
+// 连接的读写缓冲区和请求/响应的生成都使用块链，见 chainbuffer.h
+typedef ChainBuffer Buffer;
+
+#endif //__BUFFER_HPP__
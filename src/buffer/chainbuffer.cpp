@@ -0,0 +1,351 @@
+#include "chainbuffer.h"
+#include "scan.h"
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <errno.h>
+#include <new>
+
+ChainBuffer::Block *ChainBuffer::NewBlock(size_t len) {
+    size_t size = len + sizeof(Block);
+    char *mem = BlockPool::Alloc(size > BLOCK_SIZE ? size : BLOCK_SIZE, &size);
+    Block *block = new (mem) Block;
+    block->next = nullptr;
+    block->size = size;
+    block->cap = static_cast<uint32_t>(size - sizeof(Block));
+    block->begin = block->end = 0;
+    cap_ += size;
+    return block;
+}
+
+void ChainBuffer::FreeBlock(Block *block) {
+    cap_ -= block->size;
+    BlockPool::Free(reinterpret_cast<char *>(block), block->size);
+}
+
+void ChainBuffer::Link(Block *block) {
+    if (tail_) {
+        tail_->next = block;
+    } else {
+        head_ = block;
+    }
+    tail_ = block;
+}
+
+const char *ChainBuffer::Pullup(size_t len) {
+    assert(len <= readable_);
+    Block *first = head_;
+    if (!first || first->end - first->begin >= len) {
+        return Peek();
+    }
+    size_t have = first->end - first->begin;
+    if (first->cap - first->begin < len) {
+        if (first->cap >= len) {
+            memmove(first->Data(), first->Data() + first->begin, have);
+        } else {
+            Block *block = NewBlock(len);
+            memcpy(block->Data(), first->Data() + first->begin, have);
+            block->next = first->next;
+            if (tail_ == first) {
+                tail_ = block;
+            }
+            head_ = block;
+            FreeBlock(first);
+            first = block;
+        }
+        first->begin = 0;
+        first->end = have;
+    }
+    // 第一块后面的空间没有使用 (否则它是尾块，数据已经足够)，
+    // 把之后各块开头的数据接到这里
+    size_t need = len - have;
+    while (need > 0) {
+        Block *next = first->next;
+        size_t n = std::min<size_t>(need, next->end - next->begin);
+        memcpy(first->Data() + first->end, next->Data() + next->begin, n);
+        first->end += n;
+        next->begin += n;
+        need -= n;
+        if (next->begin == next->end) {
+            first->next = next->next;
+            if (tail_ == next) {
+                tail_ = first;
+            }
+            FreeBlock(next);
+        }
+    }
+    return Peek();
+}
+
+const char *ChainBuffer::At(size_t off, size_t *len) const {
+    assert(off < readable_);
+    const Block *block = head_;
+    while (off >= block->end - block->begin) {
+        off -= block->end - block->begin;
+        block = block->next;
+    }
+    *len = block->end - block->begin - off;
+    return block->Data() + block->begin + off;
+}
+
+size_t ChainBuffer::FindCRLF(size_t off) const {
+    bool cr = false; // 上一块以 '\r' 结尾
+    while (off < readable_) {
+        size_t len;
+        const char *p = At(off, &len);
+        if (cr && p[0] == '\n') {
+            return off - 1;
+        }
+        const char *crlf = Scan::FindCRLF(p, p + len);
+        if (crlf != p + len) {
+            return off + (crlf - p);
+        }
+        cr = p[len - 1] == '\r';
+        off += len;
+    }
+    return readable_;
+}
+
+void ChainBuffer::CopyOut(size_t off, void *dst, size_t len) const {
+    assert(off + len <= readable_);
+    char *out = static_cast<char *>(dst);
+    while (len > 0) {
+        size_t n;
+        const char *p = At(off, &n);
+        n = std::min(n, len);
+        memcpy(out, p, n);
+        out += n;
+        off += n;
+        len -= n;
+    }
+}
+
+size_t ChainBuffer::AppendIov(size_t off, size_t len, struct iovec *iov,
+                              int *cnt, int max) const {
+    assert(off + len <= readable_);
+    if (len == 0) {
+        return 0;
+    }
+    const Block *block = head_;
+    while (off >= block->end - block->begin) {
+        off -= block->end - block->begin;
+        block = block->next;
+    }
+    size_t done = 0;
+    while (done < len) {
+        const char *p = block->Data() + block->begin + off;
+        size_t n = std::min<size_t>(block->end - block->begin - off,
+                                    len - done);
+        struct iovec *last = *cnt > 0 ? &iov[*cnt - 1] : nullptr;
+        if (last && static_cast<char *>(last->iov_base) + last->iov_len == p) {
+            last->iov_len += n;
+        } else if (*cnt < max) {
+            iov[*cnt].iov_base = const_cast<char *>(p);
+            iov[*cnt].iov_len = n;
+            (*cnt)++;
+        } else {
+            break;
+        }
+        done += n;
+        off = 0;
+        block = block->next;
+    }
+    return done;
+}
+
+void ChainBuffer::EnsureWriteable(size_t len) {
+    if (WriteableBytes() >= len) {
+        return;
+    }
+    if (tail_ && tail_->begin == tail_->end) {
+        // 空的尾块放不下，从头开始用，仍然不够时换掉它
+        tail_->begin = tail_->end = 0;
+        if (tail_->cap >= len) {
+            return;
+        }
+        Block *prev = nullptr;
+        for (Block *block = head_; block != tail_; block = block->next) {
+            prev = block;
+        }
+        FreeBlock(tail_);
+        tail_ = prev;
+        if (prev) {
+            prev->next = nullptr;
+        } else {
+            head_ = nullptr;
+        }
+    }
+    Link(NewBlock(len));
+}
+
+void ChainBuffer::Retrieve(size_t len) {
+    assert(len <= readable_);
+    readable_ -= len;
+    while (len > 0) {
+        Block *block = head_;
+        size_t n = std::min<size_t>(len, block->end - block->begin);
+        block->begin += n;
+        len -= n;
+        if (block->begin < block->end) {
+            break;
+        }
+        if (block == tail_) {
+            // 读完时保留尾块，之后的数据从它的开头写入
+            block->begin = block->end = 0;
+            break;
+        }
+        head_ = block->next;
+        FreeBlock(block);
+    }
+}
+
+void ChainBuffer::RetrieveAll() {
+    if (!head_) {
+        return;
+    }
+    Block *block = head_->next;
+    while (block) {
+        Block *next = block->next;
+        FreeBlock(block);
+        block = next;
+    }
+    head_->next = nullptr;
+    head_->begin = head_->end = 0;
+    tail_ = head_;
+    readable_ = 0;
+}
+
+void ChainBuffer::Release() {
+    Block *block = head_;
+    while (block) {
+        Block *next = block->next;
+        FreeBlock(block);
+        block = next;
+    }
+    head_ = tail_ = nullptr;
+    readable_ = 0;
+    assert(cap_ == 0);
+}
+
+void ChainBuffer::Erase(size_t off, size_t len) {
+    assert(off + len <= readable_);
+    if (len == 0) {
+        return;
+    }
+    readable_ -= len;
+    Block *prev = nullptr;
+    Block *block = head_;
+    while (off >= block->end - block->begin) {
+        off -= block->end - block->begin;
+        prev = block;
+        block = block->next;
+    }
+    size_t size = block->end - block->begin;
+    if (off + len < size) {
+        // 在一块的中间，后面的数据前移，最多移动一块
+        char *p = block->Data() + block->begin + off;
+        memmove(p, p + len, size - off - len);
+        block->end -= len;
+        return;
+    }
+    // 截短第一块，中间的块整块删除，最后一块从后面的位置开始
+    len -= size - off;
+    block->end = block->begin + off;
+    Block *next = block->next;
+    while (len > 0 && len >= next->end - next->begin) {
+        len -= next->end - next->begin;
+        block->next = next->next;
+        if (tail_ == next) {
+            tail_ = block;
+        }
+        FreeBlock(next);
+        next = block->next;
+    }
+    if (len > 0) {
+        next->begin += len;
+    }
+    if (block->begin == block->end && block == tail_) {
+        block->begin = block->end = 0;
+    } else if (block->begin == block->end) {
+        // 第一块被删空
+        if (prev) {
+            prev->next = block->next;
+        } else {
+            head_ = block->next;
+        }
+        FreeBlock(block);
+    }
+}
+
+void ChainBuffer::Append(const char *str, size_t len) {
+    assert(str || len == 0);
+    while (len > 0) {
+        if (WriteableBytes() == 0) {
+            EnsureWriteable(1);
+        }
+        size_t n = std::min(len, WriteableBytes());
+        memcpy(BeginWrite(), str, n);
+        HashWritten(n);
+        str += n;
+        len -= n;
+    }
+}
+
+ssize_t ChainBuffer::ReadFd(int fd, int *Errno) {
+    static const int FRESH = READ_MAX / BLOCK_SIZE;
+    struct iovec iov[FRESH + 1];
+    Block *fresh[FRESH];
+    int cnt = 0;
+    size_t space = WriteableBytes();
+    if (space > 0) {
+        iov[cnt].iov_base = BeginWrite();
+        iov[cnt].iov_len = space;
+        cnt++;
+    }
+    int fresh_cnt = 0;
+    while (space < READ_MAX && fresh_cnt < FRESH) {
+        Block *block = NewBlock(0);
+        fresh[fresh_cnt++] = block;
+        iov[cnt].iov_base = block->Data();
+        iov[cnt].iov_len = block->cap;
+        cnt++;
+        space += block->cap;
+    }
+
+    // readv 按顺序填满各个 iov，返回读到的总字节数
+    const ssize_t len = readv(fd, iov, cnt);
+    if (len < 0) {
+        *Errno = errno;
+    }
+    size_t left = len > 0 ? len : 0;
+    if (WriteableBytes() > 0) {
+        size_t n = std::min(left, WriteableBytes());
+        HashWritten(n);
+        left -= n;
+    }
+    for (int i = 0; i < fresh_cnt; i++) {
+        if (left == 0) {
+            FreeBlock(fresh[i]);
+            continue;
+        }
+        Block *block = fresh[i];
+        block->end = static_cast<uint32_t>(std::min<size_t>(left, block->cap));
+        left -= block->end;
+        readable_ += block->end;
+        Link(block);
+    }
+    return len;
+}
+
+ssize_t ChainBuffer::WriteFd(int fd, int *Errno) {
+    struct iovec iov[WRITE_IOV];
+    int cnt = 0;
+    AppendIov(0, readable_, iov, &cnt, WRITE_IOV);
+    ssize_t len = writev(fd, iov, cnt);
+    if (len < 0) {
+        *Errno = errno;
+        return len;
+    }
+    Retrieve(len);
+    return len;
+}
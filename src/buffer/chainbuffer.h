@@ -0,0 +1,117 @@
+#ifndef __CHAINBUFFER_H__
+#define __CHAINBUFFER_H__
+
+#include "blockpool.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// 由固定大小的块串成的缓冲区，块从线程的 BlockPool 取得
+// 增长时在尾部追加新块，已有的数据从不搬移，读完的块立即归还；
+// ReadFd 用 readv 读入尾块剩余的空间和新取的块，WriteFd 用 writev 写出
+// 所有块，待发送的数据也可以按块导出为 iov 和文件一起发送
+// 可读区域不保证连续：需要连续数据的解析器用 Pullup 把开头的一段移到
+// 同一块中，数据本来就在一块中时不做拷贝
+// 只由一个线程 (或在锁内) 使用
+class ChainBuffer {
+  public:
+    // 增长时追加的块的大小，包括块头
+    static const size_t BLOCK_SIZE = 4096;
+    // 一次 ReadFd 最多读入的字节数
+    static const size_t READ_MAX = 64 * 1024;
+    // WriteFd 一次最多写出的块数
+    static const int WRITE_IOV = 64;
+
+    // 不持有块，第一次写入时取得
+    ChainBuffer() : head_(nullptr), tail_(nullptr), readable_(0), cap_(0) {}
+    ~ChainBuffer() { Release(); }
+    ChainBuffer(const ChainBuffer &) = delete;
+    ChainBuffer &operator=(const ChainBuffer &) = delete;
+
+    size_t ReadableBytes() const { return readable_; }
+    // 持有的块的总大小，包括块头
+    size_t Capacity() const { return cap_; }
+    // 第一块中的可读数据，ContiguousBytes 为其长度
+    const char *Peek() const {
+        return head_ ? head_->Data() + head_->begin : nullptr;
+    }
+    size_t ContiguousBytes() const {
+        return head_ ? head_->end - head_->begin : 0;
+    }
+    // 使可读区域开头的 len 字节位于同一块中，返回它们的起始位置
+    // 第一块放不下时换成一个足够大的块
+    const char *Pullup(size_t len);
+    // 可读区域中 off 处的数据，*len 为所在块中从这里开始连续的字节数
+    const char *At(size_t off, size_t *len) const;
+    // 从 off 开始查找 "\r\n"，可以跨越块的边界，返回 '\r' 的偏移，
+    // 找不到时返回 ReadableBytes()
+    size_t FindCRLF(size_t off) const;
+    // 把可读区域中 [off, off + len) 拷贝到 dst
+    void CopyOut(size_t off, void *dst, size_t len) const;
+    // 把可读区域中 [off, off + len) 按块追加到 iov[*cnt] 之后，
+    // 和前一项在内存中相接时合并；最多用到 max 项，返回放入的字节数
+    size_t AppendIov(size_t off, size_t len, struct iovec *iov, int *cnt,
+                     int max) const;
+
+    // 尾块中连续的可写空间，EnsureWriteable 保证至少 len 字节，
+    // 不够时追加一块；写入后用 HashWritten 提交
+    void EnsureWriteable(size_t len);
+    size_t WriteableBytes() const {
+        return tail_ ? tail_->cap - tail_->end : 0;
+    }
+    char *BeginWrite() { return tail_->Data() + tail_->end; }
+    void HashWritten(size_t len) {
+        tail_->end += len;
+        readable_ += len;
+    }
+
+    void Retrieve(size_t len);
+    // 丢弃所有数据，保留第一块，其余的归还 BlockPool
+    void RetrieveAll();
+    // 丢弃所有数据，所有块都归还 BlockPool
+    void Release();
+    // 删除可读区域中 [off, off + len) 的数据
+    // 整块删除或截短所在的块，只在这一段位于一块中间时移动这块后面的数据
+    void Erase(size_t off, size_t len);
+
+    void Append(std::string_view str) { Append(str.data(), str.size()); }
+    void Append(const void *data, size_t len) {
+        Append(static_cast<const char *>(data), len);
+    }
+    void Append(const char *str, size_t len);
+
+    // 读入尾块剩余的空间和新取的块，没用到的块随即归还
+    ssize_t ReadFd(int fd, int *Errno);
+    // 用 writev 写出，一次最多 WRITE_IOV 块
+    ssize_t WriteFd(int fd, int *Errno);
+
+  private:
+    // 块头放在块的开头，之后是数据区 [begin, end)
+    struct alignas(alignof(max_align_t)) Block {
+        Block *next;
+        size_t size; // 从 BlockPool 取得的大小，归还时传回
+        uint32_t cap; // 数据区大小
+        uint32_t begin;
+        uint32_t end;
+        char *Data() { return reinterpret_cast<char *>(this + 1); }
+        const char *Data() const {
+            return reinterpret_cast<const char *>(this + 1);
+        }
+    };
+
+    // 取得数据区至少 len 字节的块，不链入
+    Block *NewBlock(size_t len);
+    void FreeBlock(Block *block);
+    // 把 block 链到尾部
+    void Link(Block *block);
+
+    // 除尾块外的块都有数据；尾块可以是空的，这时从数据区的开头写入
+    Block *head_;
+    Block *tail_;
+    size_t readable_;
+    size_t cap_;
+};
+
+#endif //__CHAINBUFFER_H__
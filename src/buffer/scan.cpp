@@ -0,0 +1,220 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+static constexpr bool TokenChar(unsigned ch) {
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') ||
+           (ch >= 'A' && ch <= 'Z') || ch == '!' || ch == '#' || ch == '$' ||
+           ch == '%' || ch == '&' || ch == '\'' || ch == '*' || ch == '+' ||
+           ch == '-' || ch == '.' || ch == '^' || ch == '_' || ch == '`' ||
+           ch == '|' || ch == '~';
+}
+
+// lo[低 4 位] 的第 i 位表示高 4 位为 i 的字节是否为 token 字符，
+// 高 4 位不小于 8 的字节都不是 token 字符
+struct TokenTable {
+    uint8_t lo[16];
+    bool byte[256];
+    constexpr TokenTable() : lo(), byte() {
+        for (unsigned ch = 0; ch < 256; ch++) {
+            byte[ch] = TokenChar(ch);
+            if (byte[ch]) {
+                lo[ch & 0xf] |= 1 << (ch >> 4);
+            }
+        }
+    }
+};
+static constexpr TokenTable TOKEN_TABLE;
+
+bool Scan::IsToken(unsigned char ch) { return TOKEN_TABLE.byte[ch]; }
+
+/* 标量实现 */
+static const char *FindCRLFScalar(const char *begin, const char *end) {
+    for (const char *p = begin; p + 1 < end; p++) {
+        if (p[0] == '\r' && p[1] == '\n') {
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char *FindAnyOfScalar(const char *begin, const char *end,
+                                   const char *set, size_t set_len) {
+    bool hit[256] = {false};
+    for (size_t i = 0; i < set_len; i++) {
+        hit[static_cast<unsigned char>(set[i])] = true;
+    }
+    for (const char *p = begin; p < end; p++) {
+        if (hit[static_cast<unsigned char>(*p)]) {
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char *FindNonTokenScalar(const char *begin, const char *end) {
+    for (const char *p = begin; p < end; p++) {
+        if (!TOKEN_TABLE.byte[static_cast<unsigned char>(*p)]) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef SCAN_X86
+/* SSE4.2 实现，每次处理 16 字节 */
+__attribute__((target("sse4.2"))) static const char *
+FindCRLFSse42(const char *begin, const char *end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char *p = begin;
+    // 同时比较 p 和 p+1 开始的 16 字节，需要多读一个字节
+    for (; end - p >= 17; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        int mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("sse4.2"))) static const char *
+FindAnyOfSse42(const char *begin, const char *end, const char *set,
+               size_t set_len) {
+    if (set_len == 0 || set_len > 16) {
+        return FindAnyOfScalar(begin, end, set, set_len);
+    }
+    char buf[16] = {0};
+    for (size_t i = 0; i < set_len; i++) {
+        buf[i] = set[i];
+    }
+    const __m128i needle = _mm_loadu_si128(reinterpret_cast<__m128i *>(buf));
+    const int len = static_cast<int>(set_len);
+    const char *p = begin;
+    for (; end - p >= 16; p += 16) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int idx = _mm_cmpestri(needle, len, data, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                                   _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16) {
+            return p + idx;
+        }
+    }
+    return FindAnyOfScalar(p, end, set, set_len);
+}
+
+// 用低 4 位查表得到允许的高 4 位集合，再与高 4 位对应的位相与
+__attribute__((target("sse4.2"))) static const char *
+FindNonTokenSse42(const char *begin, const char *end) {
+    const __m128i lo_table =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(TOKEN_TABLE.lo));
+    const __m128i hi_bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0,
+                                         0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    const char *p = begin;
+    for (; end - p >= 16; p += 16) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i lo = _mm_and_si128(data, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(data, 4), nibble);
+        __m128i bits = _mm_and_si128(_mm_shuffle_epi8(lo_table, lo),
+                                     _mm_shuffle_epi8(hi_bit, hi));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindNonTokenScalar(p, end);
+}
+
+/* AVX2 实现，每次处理 32 字节 */
+__attribute__((target("avx2"))) static const char *
+FindCRLFAvx2(const char *begin, const char *end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    for (; end - p >= 33; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindCRLFSse42(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *
+FindAnyOfAvx2(const char *begin, const char *end, const char *set,
+              size_t set_len) {
+    if (set_len == 0 || set_len > 16) {
+        return FindAnyOfScalar(begin, end, set, set_len);
+    }
+    __m256i needles[16];
+    for (size_t i = 0; i < set_len; i++) {
+        needles[i] = _mm256_set1_epi8(set[i]);
+    }
+    const char *p = begin;
+    for (; end - p >= 32; p += 32) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hit = _mm256_cmpeq_epi8(data, needles[0]);
+        for (size_t i = 1; i < set_len; i++) {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, needles[i]));
+        }
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindAnyOfSse42(p, end, set, set_len);
+}
+
+__attribute__((target("avx2"))) static const char *
+FindNonTokenAvx2(const char *begin, const char *end) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(TOKEN_TABLE.lo)));
+    const __m256i hi_bit = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16,
+        32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const char *p = begin;
+    for (; end - p >= 32; p += 32) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i lo = _mm256_and_si256(data, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(data, 4), nibble);
+        __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(lo_table, lo),
+                                        _mm256_shuffle_epi8(hi_bit, hi));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, zero));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return FindNonTokenSse42(p, end);
+}
+#endif // SCAN_X86
+
+Scan::Impl Scan::Select() {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Impl{FindCRLFAvx2, FindAnyOfAvx2, FindNonTokenAvx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return Impl{FindCRLFSse42, FindAnyOfSse42, FindNonTokenSse42,
+                    "sse4.2"};
+    }
+#endif
+    return Impl{FindCRLFScalar, FindAnyOfScalar, FindNonTokenScalar,
+                "scalar"};
+}
+
+const Scan::Impl Scan::impl_ = Scan::Select();
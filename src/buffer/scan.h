@@ -0,0 +1,41 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 字节扫描原语，启动时按 CPU 支持选择 AVX2、SSE4.2 或标量实现
+// 所有函数在 [begin, end) 中查找，找不到时返回 end
+class Scan {
+  public:
+    // "\r\n" 中 '\r' 的位置
+    static const char *FindCRLF(const char *begin, const char *end) {
+        return impl_.find_crlf(begin, end);
+    }
+    // set 中任意一个字节第一次出现的位置，set_len 不超过 16
+    static const char *FindAnyOf(const char *begin, const char *end,
+                                 const char *set, size_t set_len) {
+        return impl_.find_any_of(begin, end, set, set_len);
+    }
+    // 第一个不是 token 字符 (RFC 7230 tchar) 的位置，用于校验方法和头部名
+    static const char *FindNonToken(const char *begin, const char *end) {
+        return impl_.find_non_token(begin, end);
+    }
+    static bool IsToken(unsigned char ch);
+    // 当前使用的实现
+    static const char *Name() { return impl_.name; }
+
+  private:
+    struct Impl {
+        const char *(*find_crlf)(const char *, const char *);
+        const char *(*find_any_of)(const char *, const char *, const char *,
+                                   size_t);
+        const char *(*find_non_token)(const char *, const char *);
+        const char *name;
+    };
+    static Impl Select();
+
+    static const Impl impl_;
+};
+
+#endif //__SCAN_H__
@@ -0,0 +1,346 @@
+#include "filecache.h"
+#include "httpresponse.h"
+
+using namespace std;
+
+static const char *const ENCODING_NAME[FileCache::ENC_COUNT] = {"br", "gzip"};
+static const char *const ENCODING_SUFFIX[FileCache::ENC_COUNT] = {".br", ".gz"};
+
+FileCache::FileCache()
+    : max_bytes_(64 * 1024 * 1024), check_MS_(1000), bytes_(0),
+      compressor_(new ThreadPool(1)) {}
+
+FileCache *FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(size_t max_bytes, int check_MS) {
+    lock_guard<mutex> lock(mtx_);
+    max_bytes_ = max_bytes;
+    check_MS_ = check_MS;
+    Evict();
+}
+
+FileCache::EntryPtr FileCache::Get(const string &path, int accept,
+                                   int *code) {
+    int64_t now = CoarseClock::NowMS();
+    EntryPtr stale;
+    EntryPtr stale_encoded[ENC_COUNT];
+    {
+        lock_guard<mutex> lock(mtx_);
+        auto it = index_.find(path);
+        if (it != index_.end()) {
+            NodeIter node = it->second;
+            lru_.splice(lru_.begin(), lru_, node);
+            if (now - node->checked_MS < check_MS_) {
+                *code = 200;
+                return Select(*node, accept);
+            }
+            // 先更新校验时间，同一时刻只有一个线程去 stat
+            node->checked_MS = now;
+            stale = node->entry;
+            for (int i = 0; i < ENC_COUNT; i++) {
+                stale_encoded[i] = node->encoded[i];
+            }
+        }
+    }
+
+    // stat、open、mmap 都在锁外进行
+    struct stat st;
+    *code = Stat(path, &st);
+    if (*code != 200) {
+        if (stale) {
+            lock_guard<mutex> lock(mtx_);
+            auto it = index_.find(path);
+            if (it != index_.end() && it->second->entry == stale) {
+                Remove(it->second);
+            }
+        }
+        return nullptr;
+    }
+    if (stale && Same(*stale, st) && SiblingsSame(path, stale_encoded)) {
+        lock_guard<mutex> lock(mtx_);
+        auto it = index_.find(path);
+        if (it != index_.end() && it->second->entry == stale) {
+            return Select(*it->second, accept);
+        }
+        return stale;
+    }
+
+    string_view type = HttpResponse::FileType(path);
+    bool cacheable = static_cast<size_t>(st.st_size) <= max_bytes_ / 8;
+    EntryPtr encoded[ENC_COUNT];
+    bool has_sibling = false;
+    if (cacheable) {
+        for (int i = 0; i < ENC_COUNT; i++) {
+            encoded[i] = LoadSibling(path, i, type);
+            has_sibling = has_sibling || encoded[i];
+        }
+    }
+    bool compressible = Compressible(type);
+    EntryPtr entry = Load(path, st, type, -1, compressible || has_sibling);
+    if (!entry) {
+        *code = 404;
+        return nullptr;
+    }
+    if (!cacheable) {
+        return entry;
+    }
+    lock_guard<mutex> lock(mtx_);
+    Insert(path, entry, encoded, compressible);
+    return Select(lru_.front(), accept);
+}
+
+size_t FileCache::Bytes() {
+    lock_guard<mutex> lock(mtx_);
+    return bytes_;
+}
+
+int FileCache::Stat(const string &path, struct stat *st) {
+    if (stat(path.data(), st) < 0 || S_ISDIR(st->st_mode)) {
+        return 404;
+    }
+    if (!(st->st_mode & S_IROTH)) {
+        return 403;
+    }
+    return 200;
+}
+
+bool FileCache::Same(const Entry &entry, const struct stat &st) {
+    return entry.ino == st.st_ino &&
+           entry.size == static_cast<size_t>(st.st_size) &&
+           entry.mtime.tv_sec == st.st_mtim.tv_sec &&
+           entry.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+// 兄弟文件的有无和内容都没有变化，后台压缩的结果不算兄弟文件
+bool FileCache::SiblingsSame(const string &path,
+                             const EntryPtr (&encoded)[ENC_COUNT]) {
+    for (int i = 0; i < ENC_COUNT; i++) {
+        struct stat st;
+        bool exists = Stat(path + ENCODING_SUFFIX[i], &st) == 200;
+        bool cached = encoded[i] && encoded[i]->ino != 0;
+        if (exists != cached || (exists && !Same(*encoded[i], st))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileCache::Compressible(string_view type) {
+    return type.compare(0, 5, "text/") == 0 ||
+           type.find("javascript") != string_view::npos ||
+           type.find("json") != string_view::npos ||
+           type.find("xml") != string_view::npos;
+}
+
+// 根据 entry 的大小、修改时间生成头部，etag 为空时生成强 ETag
+void FileCache::MakeHeaders(Entry *entry, string_view type, int encoding,
+                            bool vary) {
+    char buf[64];
+    if (entry->etag.empty()) {
+        unsigned long mtime_NS =
+            entry->mtime.tv_sec * 1000000000L + entry->mtime.tv_nsec;
+        snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"",
+                 static_cast<unsigned long>(entry->ino),
+                 static_cast<unsigned long>(entry->size), mtime_NS);
+        entry->etag = buf;
+    }
+    struct tm gmt;
+    gmtime_r(&entry->mtime.tv_sec, &gmt);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    entry->validators = "ETag: " + entry->etag + "\r\nLast-Modified: " + buf +
+                        "\r\n";
+    if (vary) {
+        entry->validators += "Vary: Accept-Encoding\r\n";
+    }
+    entry->content_type = "Content-type: ";
+    entry->content_type += type;
+    entry->content_type += "\r\n";
+    if (encoding >= 0) {
+        entry->content_type += "Content-Encoding: ";
+        entry->content_type += ENCODING_NAME[encoding];
+        entry->content_type += "\r\n";
+    }
+    entry->headers = entry->content_type + entry->validators +
+                     "Accept-Ranges: bytes\r\nContent-length: " +
+                     to_string(entry->size) + "\r\n";
+}
+
+FileCache::EntryPtr FileCache::Load(const string &path, const struct stat &st,
+                                    string_view type, int encoding,
+                                    bool vary) {
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_WARN("FileCache open %s error!", path.data());
+        return nullptr;
+    }
+    shared_ptr<Entry> entry = make_shared<Entry>();
+    // 以打开之后的 fstat 为准，stat 和 open 之间文件可能被替换
+    struct stat fst;
+    if (fstat(fd, &fst) < 0) {
+        fst = st;
+    }
+    entry->size = fst.st_size;
+    entry->mtime = fst.st_mtim;
+    entry->ino = fst.st_ino;
+    if (entry->size >= SENDFILE_MIN) {
+        entry->fd = fd;
+    } else {
+        if (entry->size > 0) {
+            /* MAP_PRIVATE 建立一个写入时拷贝的私有映射 */
+            void *data =
+                mmap(nullptr, entry->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                LOG_WARN("FileCache mmap %s error!", path.data());
+                close(fd);
+                return nullptr;
+            }
+            entry->data = static_cast<const char *>(data);
+        }
+        close(fd);
+    }
+    MakeHeaders(entry.get(), type, encoding, vary);
+    LOG_DEBUG("FileCache load %s, size:%d", path.data(), (int)entry->size);
+    return entry;
+}
+
+// 预压缩的 path.br / path.gz，不存在时返回 nullptr
+FileCache::EntryPtr FileCache::LoadSibling(const string &path, int encoding,
+                                           string_view type) {
+    string sibling = path + ENCODING_SUFFIX[encoding];
+    struct stat st;
+    if (Stat(sibling, &st) != 200) {
+        return nullptr;
+    }
+    return Load(sibling, st, type, encoding, true);
+}
+
+// 以 gzip 格式压缩
+bool FileCache::Gzip(const char *data, size_t len, string *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 加 16 输出 gzip 头和尾
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out->resize(deflateBound(&zs, len));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = len;
+    zs.next_out = reinterpret_cast<Bytef *>(&(*out)[0]);
+    zs.avail_out = out->size();
+    int ret = deflate(&zs, Z_FINISH);
+    out->resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// 在后台线程中执行，压缩后的大小不到原来的 90% 时才保留
+void FileCache::Compress(const string &path, const EntryPtr &entry) {
+    const char *src = entry->data;
+    void *map = nullptr;
+    if (!src && entry->fd >= 0) {
+        map = mmap(nullptr, entry->size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+        if (map == MAP_FAILED) {
+            LOG_WARN("FileCache mmap %s error!", path.data());
+            return;
+        }
+        src = static_cast<const char *>(map);
+    }
+    shared_ptr<Entry> gz = make_shared<Entry>();
+    bool ok = Gzip(src, entry->size, &gz->owned) &&
+              gz->owned.size() < entry->size - entry->size / 10;
+    if (map) {
+        munmap(map, entry->size);
+    }
+    if (!ok) {
+        LOG_DEBUG("FileCache skip gzip %s", path.data());
+        return;
+    }
+    gz->data = gz->owned.data();
+    gz->size = gz->owned.size();
+    gz->mtime = entry->mtime;
+    // 压缩结果与原文件一一对应，ETag 在原文件的基础上区分编码
+    gz->etag = "W/" + entry->etag.substr(0, entry->etag.size() - 1) +
+               "-gzip\"";
+    MakeHeaders(gz.get(), HttpResponse::FileType(path), ENC_GZIP, true);
+    LOG_DEBUG("FileCache gzip %s, %d -> %d", path.data(), (int)entry->size,
+              (int)gz->size);
+
+    lock_guard<mutex> lock(mtx_);
+    auto it = index_.find(path);
+    // 压缩期间文件可能已经重新加载或被淘汰
+    if (it == index_.end() || it->second->entry != entry) {
+        return;
+    }
+    Node &node = *it->second;
+    node.encoded[ENC_GZIP] = gz;
+    node.bytes += gz->size;
+    bytes_ += gz->size;
+    Evict();
+}
+
+// 以下在持有 mtx_ 时调用
+FileCache::EntryPtr FileCache::Select(Node &node, int accept) {
+    if ((accept & ACCEPT_BR) && node.encoded[ENC_BR]) {
+        return node.encoded[ENC_BR];
+    }
+    if (!(accept & ACCEPT_GZIP)) {
+        return node.entry;
+    }
+    if (node.encoded[ENC_GZIP]) {
+        return node.encoded[ENC_GZIP];
+    }
+    if (node.compressible && !node.compressing &&
+        node.entry->size >= COMPRESS_MIN) {
+        // 这次先返回原文件，压缩完成后的请求使用压缩版本
+        node.compressing = true;
+        string path = node.path;
+        EntryPtr entry = node.entry;
+        compressor_->AddTask(
+            [this, path, entry] { Compress(path, entry); });
+    }
+    return node.entry;
+}
+
+void FileCache::Insert(const string &path, const EntryPtr &entry,
+                       const EntryPtr (&encoded)[ENC_COUNT],
+                       bool compressible) {
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        Remove(it->second);
+    }
+    Node node;
+    node.path = path;
+    node.entry = entry;
+    node.bytes = entry->size;
+    for (int i = 0; i < ENC_COUNT; i++) {
+        node.encoded[i] = encoded[i];
+        if (encoded[i]) {
+            node.bytes += encoded[i]->size;
+        }
+    }
+    // 已有 .gz 兄弟文件时不再压缩
+    node.compressible = compressible && !encoded[ENC_GZIP];
+    node.compressing = false;
+    node.checked_MS = CoarseClock::NowMS();
+    lru_.push_front(std::move(node));
+    index_[path] = lru_.begin();
+    bytes_ += lru_.front().bytes;
+    Evict();
+}
+
+// 不会淘汰表头，刚插入的缓存项总是保留
+void FileCache::Evict() {
+    while (bytes_ > max_bytes_ && lru_.size() > 1) {
+        Remove(prev(lru_.end()));
+    }
+}
+
+void FileCache::Remove(NodeIter node) {
+    bytes_ -= node->bytes;
+    index_.erase(node->path);
+    lru_.erase(node);
+}
@@ -0,0 +1,129 @@
+#ifndef __FILECACHE_H__
+#define __FILECACHE_H__
+
+#include "../log/log.h"
+#include "../pool/threadpool.h"
+#include "../timer/coarseclock.h"
+#include <fcntl.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <zlib.h>
+
+// 进程内共享的静态文件缓存，以完整路径为键
+// 缓存项持有文件内容和预先生成的头部，按引用计数共享：
+// 被淘汰或失效的缓存项在最后一个使用它的响应写完之后才释放映射或关闭 fd
+// 缓存项在 check_MS 之后的第一次访问时用 stat 重新校验，
+// 文件的大小、修改时间或 inode 变化时重新加载
+// 总大小超过 max_bytes 时按 LRU 淘汰，超过 max_bytes / 8 的文件不缓存
+// 小于 SENDFILE_MIN 的文件做 mmap，更大的文件只保留打开的 fd，
+// 由连接用 sendfile 发送
+// 每个文件还可以有压缩版本：存在 .br/.gz 兄弟文件时直接使用，和原文件
+// 一起校验；文本类型没有 .gz 时，第一次有客户端接受 gzip 时在后台线程
+// 压缩一次，结果和原文件放在同一个缓存项中，计入总大小
+// 可在任意线程中使用
+class FileCache {
+  public:
+    enum ENCODING {
+        ENC_BR,
+        ENC_GZIP,
+        ENC_COUNT,
+    };
+    // Accept-Encoding 中可接受的编码，按位表示
+    static const int ACCEPT_BR = 1 << ENC_BR;
+    static const int ACCEPT_GZIP = 1 << ENC_GZIP;
+
+    struct Entry {
+        Entry() : data(nullptr), fd(-1), size(0), mtime{0, 0}, ino(0) {}
+        ~Entry() {
+            if (data && owned.empty()) {
+                munmap(const_cast<char *>(data), size);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        // 文件映射或 owned 中的内容，空文件和大文件为 nullptr
+        const char *data;
+        // 大文件的 fd，sendfile 使用显式偏移，多个连接可以共享
+        int fd;
+        size_t size;
+        struct timespec mtime;
+        ino_t ino; // 后台压缩生成的内容为 0
+        // 由 inode、大小和修改时间生成；后台压缩的内容为弱 ETag
+        std::string etag;
+        // 304 响应也要带的头部：
+        // "ETag: ...\r\nLast-Modified: ...\r\n[Vary: Accept-Encoding\r\n]"
+        std::string validators;
+        // "Content-type: ...\r\n[Content-Encoding: ...\r\n]"
+        std::string content_type;
+        // content_type + validators +
+        // "Accept-Ranges: bytes\r\nContent-length: ...\r\n"
+        std::string headers;
+        // 后台压缩生成的内容
+        std::string owned;
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+    static const size_t SENDFILE_MIN = 64 * 1024;
+    // 小于这个大小的文本不做后台压缩
+    static const size_t COMPRESS_MIN = 1024;
+
+    static FileCache *Instance();
+    void Init(size_t max_bytes, int check_MS);
+    // 按 accept (ACCEPT_* 的组合) 返回最合适的版本
+    // 文件不存在或不可读时返回 nullptr，code 为 404 或 403
+    EntryPtr Get(const std::string &path, int accept, int *code);
+    // 已缓存的字节数
+    size_t Bytes();
+
+  private:
+    struct Node {
+        std::string path;
+        EntryPtr entry;
+        EntryPtr encoded[ENC_COUNT];
+        bool compressible;
+        bool compressing; // 已提交后台压缩，压缩收益太小时结果为空
+        size_t bytes;
+        int64_t checked_MS; // 上次校验的时间
+    };
+    typedef std::list<Node>::iterator NodeIter;
+
+    FileCache();
+    ~FileCache() = default;
+    static EntryPtr Load(const std::string &path, const struct stat &st,
+                         std::string_view type, int encoding, bool vary);
+    static EntryPtr LoadSibling(const std::string &path, int encoding,
+                                std::string_view type);
+    static bool SiblingsSame(const std::string &path,
+                             const EntryPtr (&encoded)[ENC_COUNT]);
+    static bool Same(const Entry &entry, const struct stat &st);
+    static int Stat(const std::string &path, struct stat *st);
+    static bool Compressible(std::string_view type);
+    static bool Gzip(const char *data, size_t len, std::string *out);
+    static void MakeHeaders(Entry *entry, std::string_view type,
+                            int encoding, bool vary);
+    void Compress(const std::string &path, const EntryPtr &entry);
+    EntryPtr Select(Node &node, int accept);
+    void Insert(const std::string &path, const EntryPtr &entry,
+                const EntryPtr (&encoded)[ENC_COUNT], bool compressible);
+    void Remove(NodeIter it);
+    void Evict();
+
+    size_t max_bytes_;
+    int check_MS_;
+    size_t bytes_;
+    // 表头是最近使用的
+    std::list<Node> lru_;
+    std::unordered_map<std::string, NodeIter> index_;
+    std::mutex mtx_;
+    // 后台压缩线程
+    std::unique_ptr<ThreadPool> compressor_;
+};
+
+#endif //__FILECACHE_H__
@@ -0,0 +1,107 @@
+#include "formdecoder.h"
+#include "../buffer/scan.h"
+
+int FormDecoder::HexValue(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    return -1;
+}
+
+bool FormDecoder::Feed(const char *data, size_t len) {
+    const char *end = data + len;
+    while (data < end) {
+        if (escape_) {
+            if (HexValue(*data) < 0) {
+                // 这个字符不属于转义，按普通字符重新处理
+                FlushEscape();
+                continue;
+            }
+            hex_[hex_len_++] = *data++;
+            if (hex_len_ == 2) {
+                Target() += static_cast<char>(HexValue(hex_[0]) * 16 +
+                                              HexValue(hex_[1]));
+                escape_ = false;
+            }
+            continue;
+        }
+        // 普通字符整段追加，直接跳到下一个需要处理的字符
+        const char *p = Scan::FindAnyOf(data, end, "=&+%", 4);
+        Target().append(data, p - data);
+        data = p;
+        if (data < end) {
+            switch (*data++) {
+            case '=':
+                if (in_value_) {
+                    value_ += '=';
+                } else {
+                    in_value_ = true;
+                }
+                break;
+            case '&':
+                Save();
+                break;
+            case '+':
+                Target() += ' ';
+                break;
+            default: // '%'
+                escape_ = true;
+                hex_len_ = 0;
+                break;
+            }
+        }
+        if (key_.size() > MAX_FIELD || value_.size() > MAX_FIELD) {
+            LOG_WARN("Form field too large");
+            return false;
+        }
+    }
+    return true;
+}
+
+void FormDecoder::End() {
+    if (escape_) {
+        FlushEscape();
+    }
+    Save();
+}
+
+void FormDecoder::FlushEscape() {
+    Target() += '%';
+    Target().append(hex_, hex_len_);
+    escape_ = false;
+}
+
+void FormDecoder::Save() {
+    if (!key_.empty()) {
+        (*post_)[key_] = value_;
+        LOG_DEBUG("%s = %s", key_.c_str(), value_.c_str());
+    }
+    key_.clear();
+    value_.clear();
+    in_value_ = false;
+}
+
+bool FormSink::OnBodyStart(HttpRequest *request) {
+    decoder_.reset();
+    if (request->IsForm()) {
+        decoder_.emplace(request->MutablePost());
+    }
+    return true;
+}
+
+bool FormSink::OnBody(const char *data, size_t len) {
+    return decoder_ ? decoder_->Feed(data, len) : true;
+}
+
+void FormSink::OnBodyEnd() {
+    if (decoder_) {
+        decoder_->End();
+        decoder_.reset();
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef __FORMDECODER_H__
+#define __FORMDECODER_H__
+
+#include "httprequest.h"
+#include <memory_resource>
+#include <optional>
+#include <stddef.h>
+#include <string>
+
+// application/x-www-form-urlencoded 的增量解码器，每个请求体构造一个
+// 请求体可以分成任意多段交给 Feed，"%XX" 和字段的边界可以跨越两段；
+// 解码出的字段存入请求的表单表，同名字段取最后一个
+class FormDecoder {
+  public:
+    // 单个名字或值解码后的长度上限
+    static const size_t MAX_FIELD = 64 * 1024;
+
+    // 名字和值使用 post 的内存资源 (请求的 arena)
+    explicit FormDecoder(HttpRequest::PostMap *post)
+        : post_(post), key_(post->get_allocator().resource()),
+          value_(post->get_allocator().resource()), in_value_(false),
+          escape_(false), hex_len_(0) {}
+
+    // 字段超过 MAX_FIELD 时返回 false
+    bool Feed(const char *data, size_t len);
+    // 请求体结束，保存最后一个字段
+    void End();
+
+  private:
+    std::pmr::string &Target() { return in_value_ ? value_ : key_; }
+    // 保存当前字段，名字为空的字段 (如 "a&&b" 中间的) 忽略
+    void Save();
+    // "%" 之后不是两位十六进制数，按原样保留已读到的字符
+    void FlushEscape();
+    static int HexValue(char ch);
+
+    HttpRequest::PostMap *post_;
+    std::pmr::string key_;
+    std::pmr::string value_;
+    bool in_value_; // 已读到 '='
+    bool escape_;   // 在 "%XX" 中
+    int hex_len_;   // "%" 之后已读到的十六进制位数
+    char hex_[2];
+};
+
+// HttpConn 安装在请求上的 BodySink，接收超过内联上限的请求体：
+// 表单边读边解码到请求的表单表，之后和内联的表单一样处理；
+// 其他类型的请求体没有处理程序，读过即丢弃
+class FormSink : public BodySink {
+  public:
+    bool OnBodyStart(HttpRequest *request) override;
+    bool OnBody(const char *data, size_t len) override;
+    void OnBodyEnd() override;
+
+  private:
+    // 当前请求体是表单时存在
+    std::optional<FormDecoder> decoder_;
+};
+
+#endif //__FORMDECODER_H__
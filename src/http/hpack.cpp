@@ -0,0 +1,508 @@
+#include "hpack.h"
+
+using namespace std;
+
+namespace {
+struct StaticEntry {
+    string_view name;
+    string_view value;
+};
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t len;
+};
+} // namespace
+
+static constexpr StaticEntry STATIC_TABLE[HpackTable::STATIC_COUNT] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// 256 个字节和 EOS 的 Huffman 编码 (RFC 7541 附录 B)
+static constexpr HuffmanCode HUFFMAN_CODES[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// 由编码表生成的解码树，child 为正数时是内部节点的下标，
+// 为负数时是叶子 -(sym + 1)，0 表示不存在
+struct HuffmanTree {
+    int16_t child[256][2];
+    constexpr HuffmanTree() : child() {
+        int nodes = 1;
+        for (int sym = 0; sym < 257; sym++) {
+            uint32_t code = HUFFMAN_CODES[sym].code;
+            int node = 0;
+            for (int bit = HUFFMAN_CODES[sym].len - 1; bit >= 0; bit--) {
+                int b = (code >> bit) & 1;
+                if (bit == 0) {
+                    child[node][b] = static_cast<int16_t>(-(sym + 1));
+                } else {
+                    if (child[node][b] == 0) {
+                        child[node][b] = static_cast<int16_t>(nodes++);
+                    }
+                    node = child[node][b];
+                }
+            }
+        }
+    }
+};
+static constexpr HuffmanTree HUFFMAN_TREE;
+
+void Hpack::EncodeInt(uint64_t value, int prefix_bits, uint8_t first,
+                      string *out) {
+    uint64_t max = (1u << prefix_bits) - 1;
+    if (value < max) {
+        out->push_back(static_cast<char>(first | value));
+        return;
+    }
+    out->push_back(static_cast<char>(first | max));
+    value -= max;
+    while (value >= 128) {
+        out->push_back(static_cast<char>((value & 127) | 128));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+// 超过 2^28 的整数按错误处理
+bool Hpack::DecodeInt(const uint8_t *&p, const uint8_t *end, int prefix_bits,
+                      uint64_t *value) {
+    if (p == end) {
+        return false;
+    }
+    uint64_t max = (1u << prefix_bits) - 1;
+    uint64_t v = *p++ & max;
+    if (v == max) {
+        int shift = 0;
+        uint8_t b;
+        do {
+            if (p == end || shift > 21) {
+                return false;
+            }
+            b = *p++;
+            v += static_cast<uint64_t>(b & 127) << shift;
+            shift += 7;
+        } while (b & 128);
+    }
+    *value = v;
+    return true;
+}
+
+size_t Hpack::HuffmanLength(string_view str) {
+    size_t bits = 0;
+    for (unsigned char ch : str) {
+        bits += HUFFMAN_CODES[ch].len;
+    }
+    return (bits + 7) / 8;
+}
+
+void Hpack::HuffmanEncode(string_view str, string *out) {
+    uint64_t acc = 0;
+    int bits = 0;
+    for (unsigned char ch : str) {
+        acc = (acc << HUFFMAN_CODES[ch].len) | HUFFMAN_CODES[ch].code;
+        bits += HUFFMAN_CODES[ch].len;
+        while (bits >= 8) {
+            bits -= 8;
+            out->push_back(static_cast<char>(acc >> bits));
+        }
+        acc &= (1u << bits) - 1;
+    }
+    if (bits > 0) {
+        // 用 EOS 的前缀 (全 1) 填充
+        out->push_back(static_cast<char>((acc << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+// 填充不能超过 7 位且必须全为 1，不能出现 EOS
+bool Hpack::HuffmanDecode(const uint8_t *data, size_t len, string *out) {
+    int node = 0;
+    int pad_bits = 0;
+    bool pad_ones = true;
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (data[i] >> bit) & 1;
+            int next = HUFFMAN_TREE.child[node][b];
+            pad_bits++;
+            pad_ones = pad_ones && b;
+            if (next < 0) {
+                if (next == -257) {
+                    return false;
+                }
+                out->push_back(static_cast<char>(-next - 1));
+                node = 0;
+                pad_bits = 0;
+                pad_ones = true;
+            } else if (next == 0) {
+                return false;
+            } else {
+                node = next;
+            }
+        }
+    }
+    return pad_bits <= 7 && pad_ones;
+}
+
+void HpackTable::Add(string_view name, string_view value) {
+    size_t size = EntrySize(name, value);
+    if (size > max_size_) {
+        // 比整个表还大的条目使表变空
+        entries_.clear();
+        size_ = 0;
+        return;
+    }
+    Evict(max_size_ - size);
+    entries_.emplace_front(string(name), string(value));
+    size_ += size;
+}
+
+void HpackTable::SetMaxSize(size_t max_size) {
+    max_size_ = max_size;
+    Evict(max_size);
+}
+
+void HpackTable::Evict(size_t limit) {
+    while (size_ > limit) {
+        size_ -= EntrySize(entries_.back().first, entries_.back().second);
+        entries_.pop_back();
+    }
+}
+
+bool HpackTable::Get(size_t index, string_view *name,
+                     string_view *value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_COUNT) {
+        *name = STATIC_TABLE[index - 1].name;
+        *value = STATIC_TABLE[index - 1].value;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= entries_.size()) {
+        return false;
+    }
+    *name = entries_[index].first;
+    *value = entries_[index].second;
+    return true;
+}
+
+size_t HpackTable::Find(string_view name, string_view value,
+                        bool *full) const {
+    size_t name_index = 0;
+    *full = false;
+    for (size_t i = 0; i < STATIC_COUNT; i++) {
+        if (STATIC_TABLE[i].name == name) {
+            if (STATIC_TABLE[i].value == value) {
+                *full = true;
+                return i + 1;
+            }
+            if (name_index == 0) {
+                name_index = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries_.size(); i++) {
+        if (entries_[i].first == name) {
+            if (entries_[i].second == value) {
+                *full = true;
+                return STATIC_COUNT + 1 + i;
+            }
+            if (name_index == 0) {
+                name_index = STATIC_COUNT + 1 + i;
+            }
+        }
+    }
+    return name_index;
+}
+
+bool HpackDecoder::DecodeString(const uint8_t *&p, const uint8_t *end,
+                                string *out) {
+    if (p == end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t len;
+    if (!Hpack::DecodeInt(p, end, 7, &len) ||
+        len > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    out->clear();
+    if (huffman) {
+        if (!Hpack::HuffmanDecode(p, len, out)) {
+            return false;
+        }
+    } else {
+        out->assign(reinterpret_cast<const char *>(p), len);
+    }
+    p += len;
+    return true;
+}
+
+HpackDecoder::DECODE_RESULT
+HpackDecoder::Decode(const uint8_t *data, size_t len,
+                     vector<HpackHeader> *headers) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    // 超过上限后继续解码以更新动态表，但不再保存头部
+    size_t list_size = 0;
+    auto fits = [&](size_t name_len, size_t value_len) {
+        list_size += name_len + value_len + 32;
+        return list_size <= max_list_size_;
+    };
+    while (p < end) {
+        uint8_t b = *p;
+        uint64_t index;
+        string_view name, value;
+        if (b & 0x80) {
+            // 索引的头部
+            if (!Hpack::DecodeInt(p, end, 7, &index) ||
+                !table_.Get(index, &name, &value)) {
+                return DECODE_ERROR;
+            }
+            if (fits(name.size(), value.size())) {
+                headers->emplace_back(string(name), string(value));
+            }
+            continue;
+        }
+        if ((b & 0xe0) == 0x20) {
+            // 动态表大小更新
+            if (!Hpack::DecodeInt(p, end, 5, &index) || index > max_size_) {
+                return DECODE_ERROR;
+            }
+            table_.SetMaxSize(index);
+            continue;
+        }
+        // 字面量：0x40 加入动态表，0x00 不加入，0x10 永不加入
+        bool add = b & 0x40;
+        if (!Hpack::DecodeInt(p, end, add ? 6 : 4, &index)) {
+            return DECODE_ERROR;
+        }
+        HpackHeader header;
+        size_t name_len;
+        if (index > 0) {
+            if (!table_.Get(index, &name, &value)) {
+                return DECODE_ERROR;
+            }
+            // 超过上限之后不保存的头部只需要名字的长度
+            name_len = name.size();
+            if (add || list_size <= max_list_size_) {
+                header.first.assign(name.data(), name.size());
+            }
+        } else if (!DecodeString(p, end, &header.first)) {
+            return DECODE_ERROR;
+        } else {
+            name_len = header.first.size();
+        }
+        if (!DecodeString(p, end, &header.second)) {
+            return DECODE_ERROR;
+        }
+        if (add) {
+            table_.Add(header.first, header.second);
+        }
+        if (fits(name_len, header.second.size())) {
+            headers->push_back(std::move(header));
+        }
+    }
+    if (list_size > max_list_size_) {
+        headers->clear();
+        return DECODE_TOO_LARGE;
+    }
+    return DECODE_OK;
+}
+
+// 编码器的动态表不超过默认大小
+void HpackEncoder::SetMaxTableSize(size_t max_size) {
+    if (max_size > HpackTable::DEFAULT_SIZE) {
+        max_size = HpackTable::DEFAULT_SIZE;
+    }
+    if (max_size != table_.MaxSize()) {
+        table_.SetMaxSize(max_size);
+        size_changed_ = true;
+    }
+}
+
+void HpackEncoder::Begin(string *out) {
+    if (size_changed_) {
+        Hpack::EncodeInt(table_.MaxSize(), 5, 0x20, out);
+        size_changed_ = false;
+    }
+}
+
+void HpackEncoder::EncodeStatus(int code, string *out) {
+    int index = 0;
+    switch (code) {
+    case 200:
+        index = 8;
+        break;
+    case 204:
+        index = 9;
+        break;
+    case 206:
+        index = 10;
+        break;
+    case 304:
+        index = 11;
+        break;
+    case 400:
+        index = 12;
+        break;
+    case 404:
+        index = 13;
+        break;
+    case 500:
+        index = 14;
+        break;
+    default:
+        Encode(":status", to_string(code), false, out);
+        return;
+    }
+    Hpack::EncodeInt(index, 7, 0x80, out);
+}
+
+void HpackEncoder::Encode(string_view name, string_view value, bool index,
+                          string *out) {
+    bool full;
+    size_t found = table_.Find(name, value, &full);
+    if (full) {
+        Hpack::EncodeInt(found, 7, 0x80, out);
+        return;
+    }
+    if (index) {
+        Hpack::EncodeInt(found, 6, 0x40, out);
+    } else {
+        Hpack::EncodeInt(found, 4, 0x00, out);
+    }
+    if (found == 0) {
+        EncodeString(name, out);
+    }
+    EncodeString(value, out);
+    if (index) {
+        table_.Add(name, value);
+    }
+}
+
+void HpackEncoder::EncodeString(string_view str, string *out) {
+    size_t huffman_len = Hpack::HuffmanLength(str);
+    if (huffman_len < str.size()) {
+        Hpack::EncodeInt(huffman_len, 7, 0x80, out);
+        Hpack::HuffmanEncode(str, out);
+    } else {
+        Hpack::EncodeInt(str.size(), 7, 0x00, out);
+        out->append(str.data(), str.size());
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HPACK (RFC 7541) 头部压缩，HTTP/2 连接的每个方向各有一个编码器/解码器
+typedef std::pair<std::string, std::string> HpackHeader;
+
+// 静态表之后的动态表，索引从 STATIC_COUNT + 1 开始，最新的条目索引最小
+// 每个条目按名字和值的长度加 32 计入大小，超过上限时从最旧的开始淘汰
+class HpackTable {
+  public:
+    static const size_t STATIC_COUNT = 61;
+    static const size_t DEFAULT_SIZE = 4096;
+
+    HpackTable() : size_(0), max_size_(DEFAULT_SIZE) {}
+    void Add(std::string_view name, std::string_view value);
+    void SetMaxSize(size_t max_size);
+    size_t MaxSize() const { return max_size_; }
+    // index 从 1 开始，覆盖静态表和动态表，越界时返回 false
+    bool Get(size_t index, std::string_view *name,
+             std::string_view *value) const;
+    // 完全匹配时返回索引并设置 *full，只有名字匹配时返回名字的索引，
+    // 找不到返回 0
+    size_t Find(std::string_view name, std::string_view value,
+                bool *full) const;
+
+  private:
+    static size_t EntrySize(std::string_view name, std::string_view value) {
+        return name.size() + value.size() + 32;
+    }
+    void Evict(size_t limit);
+
+    std::deque<HpackHeader> entries_; // 表头是最新的
+    size_t size_;
+    size_t max_size_;
+};
+
+// 解码一个完整的头部块，保持动态表在多个头部块之间的状态
+class HpackDecoder {
+  public:
+    enum DECODE_RESULT {
+        DECODE_OK,
+        // 头部列表超过上限，块已完整解码、动态表保持一致，头部被丢弃
+        DECODE_TOO_LARGE,
+        // 格式错误，这时连接必须以 COMPRESSION_ERROR 关闭
+        DECODE_ERROR,
+    };
+
+    // max_size 为我们在 SETTINGS_HEADER_TABLE_SIZE 中通告的上限，
+    // max_list_size 为 SETTINGS_MAX_HEADER_LIST_SIZE 中通告的上限
+    // 一个字节的索引就能引用动态表中很长的条目，解码结果必须按
+    // 展开后的大小限制
+    explicit HpackDecoder(size_t max_size = HpackTable::DEFAULT_SIZE,
+                          size_t max_list_size = SIZE_MAX)
+        : max_size_(max_size), max_list_size_(max_list_size) {}
+    // 头部列表按每个头部的名字和值的长度加 32 计算大小
+    DECODE_RESULT Decode(const uint8_t *data, size_t len,
+                         std::vector<HpackHeader> *headers);
+
+  private:
+    bool DecodeString(const uint8_t *&p, const uint8_t *end,
+                      std::string *out);
+
+    HpackTable table_;
+    size_t max_size_;
+    size_t max_list_size_;
+};
+
+// 编码响应头部：静态表中的 :status 直接用索引，其余头部按 index 决定是否
+// 加入动态表，已在表中的完全匹配直接用索引；字符串在 Huffman 编码更短时
+// 使用 Huffman 编码
+class HpackEncoder {
+  public:
+    // 对端 SETTINGS_HEADER_TABLE_SIZE 变化，在下一个头部块开头通告
+    void SetMaxTableSize(size_t max_size);
+    // 每个头部块开始时调用
+    void Begin(std::string *out);
+    void EncodeStatus(int code, std::string *out);
+    void Encode(std::string_view name, std::string_view value, bool index,
+                std::string *out);
+
+  private:
+    void EncodeString(std::string_view str, std::string *out);
+
+    HpackTable table_;
+    bool size_changed_ = false;
+};
+
+// 整数和 Huffman 编解码
+namespace Hpack {
+void EncodeInt(uint64_t value, int prefix_bits, uint8_t first,
+               std::string *out);
+bool DecodeInt(const uint8_t *&p, const uint8_t *end, int prefix_bits,
+               uint64_t *value);
+size_t HuffmanLength(std::string_view str);
+void HuffmanEncode(std::string_view str, std::string *out);
+bool HuffmanDecode(const uint8_t *data, size_t len, std::string *out);
+} // namespace Hpack
+
+#endif //__HPACK_H__
@@ -0,0 +1,809 @@
+#include "http2conn.h"
+#include "httpconn.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace std;
+
+// 头部块 (含 CONTINUATION) 的上限
+static const size_t MAX_HEADER_BLOCK = 64 * 1024;
+
+static uint32_t ReadU32(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) |
+           p[3];
+}
+
+static void WriteU32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static bool EqualsNoCase(string_view a, string_view b) {
+    return a.size() == b.size() &&
+           strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+// 头部名和值中不能有会破坏还原出的 HTTP/1.1 文本的字符
+static bool SafeField(string_view str) {
+    return str.find_first_of(string_view("\r\n\0", 3)) == string_view::npos;
+}
+
+// "accept-encoding" -> "Accept-Encoding"
+static void AppendCanonical(string_view name, Buffer *buff) {
+    char buf[128];
+    if (name.size() > sizeof(buf)) {
+        buff->Append(name);
+        return;
+    }
+    bool upper = true;
+    for (size_t i = 0; i < name.size(); i++) {
+        char ch = name[i];
+        buf[i] = upper && ch >= 'a' && ch <= 'z' ? ch - 'a' + 'A' : ch;
+        upper = ch == '-';
+    }
+    buff->Append(buf, name.size());
+}
+
+// HTTP2-Settings 为 base64url 编码，没有填充
+static bool Base64UrlDecode(string_view str, string *out) {
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char ch : str) {
+        int v;
+        if (ch >= 'A' && ch <= 'Z') {
+            v = ch - 'A';
+        } else if (ch >= 'a' && ch <= 'z') {
+            v = ch - 'a' + 26;
+        } else if (ch >= '0' && ch <= '9') {
+            v = ch - '0' + 52;
+        } else if (ch == '-') {
+            v = 62;
+        } else if (ch == '_') {
+            v = 63;
+        } else if (ch == '=') {
+            break;
+        } else {
+            return false;
+        }
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out->push_back(static_cast<char>(acc >> bits));
+        }
+    }
+    return true;
+}
+
+Http2Conn::Http2Conn(HttpConn *conn)
+    : conn_(conn), preface_received_(false), settings_sent_(false),
+      goaway_(false), pending_(0), last_stream_id_(0),
+      conn_window_(DEFAULT_WINDOW), max_frame_size_(DEFAULT_FRAME_SIZE),
+      initial_window_(DEFAULT_WINDOW), continuation_id_(0),
+      continuation_end_stream_(false),
+      decoder_(HpackTable::DEFAULT_SIZE, HttpRequest::MAX_HEADER_SIZE) {
+    // 多个流的帧交错写出，每次写的末尾常是小帧，关闭 Nagle 避免和客户端
+    // 的延迟确认互相等待
+    int on = 1;
+    if (setsockopt(conn_->fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) <
+        0) {
+        LOG_WARN("Client[%d] set TCP_NODELAY error!", conn_->fd_);
+    }
+}
+
+void Http2Conn::Release() {
+    req_buff_.Release();
+    resp_buff_.Release();
+    request_.Release();
+    response_.Shrink();
+    string().swap(head_block_);
+    if (continuation_id_ == 0) {
+        string().swap(header_block_);
+    }
+}
+
+bool Http2Conn::HasPreface(const Buffer &buff, bool *partial) {
+    char head[PREFACE.size()];
+    size_t n = min(buff.ReadableBytes(), PREFACE.size());
+    buff.CopyOut(0, head, n);
+    bool match = memcmp(head, PREFACE.data(), n) == 0;
+    *partial = match && n < PREFACE.size();
+    return match && n == PREFACE.size();
+}
+
+bool Http2Conn::WantsUpgrade(const HttpRequest &request) {
+    string_view upgrade = request.GetHeader(HttpRequest::HDR_UPGRADE);
+    if (request.GetHeader(HttpRequest::HDR_HTTP2_SETTINGS).empty() ||
+        !request.GetHeader(HttpRequest::HDR_TRANSFER_ENCODING).empty()) {
+        return false;
+    }
+    string_view length = request.GetHeader(HttpRequest::HDR_CONTENT_LENGTH);
+    if (!length.empty() && length != "0") {
+        return false;
+    }
+    while (!upgrade.empty()) {
+        size_t comma = upgrade.find(',');
+        string_view token = upgrade.substr(0, comma);
+        while (!token.empty() && token.front() == ' ') {
+            token.remove_prefix(1);
+        }
+        while (!token.empty() && token.back() == ' ') {
+            token.remove_suffix(1);
+        }
+        if (EqualsNoCase(token, "h2c")) {
+            return true;
+        }
+        upgrade = comma == string_view::npos ? string_view()
+                                             : upgrade.substr(comma + 1);
+    }
+    return false;
+}
+
+void Http2Conn::Upgrade(HttpRequest &request) {
+    static const char SWITCHING[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                                    "Connection: Upgrade\r\n"
+                                    "Upgrade: h2c\r\n\r\n";
+    WriteRaw(SWITCHING, sizeof(SWITCHING) - 1);
+    WriteSettings();
+    // 101 响应即是对 HTTP2-Settings 的确认
+    string settings;
+    string_view header = request.GetHeader(HttpRequest::HDR_HTTP2_SETTINGS);
+    if (Base64UrlDecode(header, &settings) && settings.size() % 6 == 0) {
+        ApplySettings(reinterpret_cast<const uint8_t *>(settings.data()),
+                      settings.size());
+    }
+    last_stream_id_ = 1;
+    Stream &stream = streams_[1];
+    stream.window = initial_window_;
+    stream.remote_closed = true;
+    Respond(1, stream, request, true);
+}
+
+bool Http2Conn::Process() {
+    Buffer &in = conn_->read_buff_;
+    // 留出一个输出项给本次生成的控制帧
+    if (conn_->out_cnt_ >= HttpConn::OUT_SIZE - 1) {
+        return conn_->to_write_ > 0;
+    }
+    if (!preface_received_) {
+        // 升级的连接在 101 之后才收到前言，流 1 的响应等收到前言再发送，
+        // 有的客户端在切换协议时只能缓存有限的数据
+        bool partial;
+        if (HasPreface(in, &partial)) {
+            in.Retrieve(PREFACE.size());
+            preface_received_ = true;
+            if (!settings_sent_) {
+                WriteSettings();
+            }
+        } else if (!partial) {
+            LOG_WARN("Client[%d] bad HTTP/2 preface", conn_->fd_);
+            in.RetrieveAll();
+            conn_->closing_ = true;
+            Flush();
+            return conn_->to_write_ > 0;
+        }
+    }
+    while (preface_received_ && !goaway_ &&
+           in.ReadableBytes() >= FRAME_HEADER_LEN) {
+        // 帧在读缓冲区中可能跨越块的边界，先把帧头移到一块中
+        const uint8_t *p =
+            reinterpret_cast<const uint8_t *>(in.Pullup(FRAME_HEADER_LEN));
+        Frame frame;
+        frame.len = (p[0] << 16) | (p[1] << 8) | p[2];
+        frame.type = p[3];
+        frame.flags = p[4];
+        frame.stream_id = ReadU32(p + 5) & 0x7fffffff;
+        // 我们的 SETTINGS_MAX_FRAME_SIZE 为默认值
+        if (frame.len > DEFAULT_FRAME_SIZE) {
+            GoAway(FRAME_SIZE_ERROR);
+            break;
+        }
+        if (in.ReadableBytes() < FRAME_HEADER_LEN + frame.len) {
+            break;
+        }
+        // 整个帧到齐后同样移到一块中，本来就在一块中时不拷贝
+        frame.payload = reinterpret_cast<const uint8_t *>(
+                            in.Pullup(FRAME_HEADER_LEN + frame.len)) +
+                        FRAME_HEADER_LEN;
+        bool ok = HandleFrame(frame);
+        in.Retrieve(FRAME_HEADER_LEN + frame.len);
+        if (!ok || conn_->out_cnt_ >= HttpConn::OUT_SIZE - 1) {
+            break;
+        }
+    }
+    if (goaway_) {
+        in.RetrieveAll();
+    } else if (preface_received_) {
+        Schedule();
+    }
+    Flush();
+    return conn_->to_write_ > 0;
+}
+
+// 返回 false 表示连接出错，已发送 GOAWAY
+bool Http2Conn::HandleFrame(const Frame &frame) {
+    if (continuation_id_ != 0 && frame.type != CONTINUATION) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    }
+    switch (frame.type) {
+    case DATA:
+        return OnData(frame);
+    case HEADERS:
+        return OnHeaders(frame);
+    case PRIORITY:
+        if (frame.stream_id == 0 || frame.len != 5) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        return true;
+    case RST_STREAM:
+        if (frame.stream_id == 0 || frame.len != 4 ||
+            frame.stream_id > last_stream_id_) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        streams_.erase(frame.stream_id);
+        return true;
+    case SETTINGS:
+        return OnSettings(frame);
+    case PING:
+        if (frame.stream_id != 0 || frame.len != 8) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        if (!(frame.flags & FLAG_ACK)) {
+            WriteFrameHeader(8, PING, FLAG_ACK, 0);
+            WriteRaw(frame.payload, 8);
+        }
+        return true;
+    case GOAWAY:
+        // 客户端不再发起新的流，已有的流照常完成
+        return true;
+    case WINDOW_UPDATE:
+        return OnWindowUpdate(frame);
+    case CONTINUATION:
+        if (frame.stream_id != continuation_id_ || continuation_id_ == 0 ||
+            header_block_.size() + frame.len > MAX_HEADER_BLOCK) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        header_block_.append(reinterpret_cast<const char *>(frame.payload),
+                             frame.len);
+        if (frame.flags & FLAG_END_HEADERS) {
+            uint32_t stream_id = continuation_id_;
+            continuation_id_ = 0;
+            return OnHeaderBlock(stream_id, continuation_end_stream_);
+        }
+        return true;
+    case PUSH_PROMISE:
+        // 客户端不能推送
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    default:
+        // 忽略未知类型的帧
+        return true;
+    }
+}
+
+bool Http2Conn::OnHeaders(const Frame &frame) {
+    if (frame.stream_id == 0 || frame.stream_id % 2 == 0) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    }
+    const uint8_t *p = frame.payload;
+    size_t len = frame.len;
+    size_t pad = 0;
+    if (frame.flags & FLAG_PADDED) {
+        if (len < 1) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        pad = *p++;
+        len--;
+    }
+    if (frame.flags & FLAG_PRIORITY) {
+        // 不做优先级调度，所有流轮转发送
+        if (len < 5) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        p += 5;
+        len -= 5;
+    }
+    if (pad > len) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    }
+    header_block_.assign(reinterpret_cast<const char *>(p), len - pad);
+    bool end_stream = frame.flags & FLAG_END_STREAM;
+    if (frame.flags & FLAG_END_HEADERS) {
+        return OnHeaderBlock(frame.stream_id, end_stream);
+    }
+    continuation_id_ = frame.stream_id;
+    continuation_end_stream_ = end_stream;
+    return true;
+}
+
+// 头部块必须解码，即使流会被拒绝，否则两端的动态表不再一致
+bool Http2Conn::OnHeaderBlock(uint32_t stream_id, bool end_stream) {
+    vector<HpackHeader> headers;
+    HpackDecoder::DECODE_RESULT ret = decoder_.Decode(
+        reinterpret_cast<const uint8_t *>(header_block_.data()),
+        header_block_.size(), &headers);
+    header_block_.clear();
+    if (ret == HpackDecoder::DECODE_ERROR) {
+        GoAway(COMPRESSION_ERROR);
+        return false;
+    }
+    // 超过通告的 MAX_HEADER_LIST_SIZE，只拒绝这个流
+    bool too_large = ret == HpackDecoder::DECODE_TOO_LARGE;
+    auto it = streams_.find(stream_id);
+    if (it != streams_.end()) {
+        // trailer，内容不使用
+        Stream &stream = it->second;
+        if (stream.remote_closed || !end_stream) {
+            ResetStream(stream_id, stream.remote_closed ? STREAM_CLOSED
+                                                        : PROTOCOL_ERROR);
+            return true;
+        }
+        if (too_large) {
+            ResetStream(stream_id, ENHANCE_YOUR_CALM);
+            return true;
+        }
+        stream.remote_closed = true;
+        StartRequest(stream_id, stream);
+        return true;
+    }
+    // 流 id 必须递增，重用已关闭的流是连接错误 (RFC 9113 5.1.1)
+    if (stream_id <= last_stream_id_) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    }
+    last_stream_id_ = stream_id;
+    if (too_large) {
+        LOG_WARN("Client[%d] stream %u header list too large", conn_->fd_,
+                 stream_id);
+        ResetStream(stream_id, ENHANCE_YOUR_CALM);
+        return true;
+    }
+    if (streams_.size() >= MAX_STREAMS) {
+        ResetStream(stream_id, REFUSED_STREAM);
+        return true;
+    }
+    Stream &stream = streams_[stream_id];
+    stream.window = initial_window_;
+    stream.headers = std::move(headers);
+    if (end_stream) {
+        stream.remote_closed = true;
+        StartRequest(stream_id, stream);
+    }
+    return true;
+}
+
+bool Http2Conn::OnData(const Frame &frame) {
+    if (frame.stream_id == 0) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    }
+    const uint8_t *p = frame.payload;
+    size_t len = frame.len;
+    if (frame.flags & FLAG_PADDED) {
+        if (len < 1 || p[0] >= len) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        len -= 1 + p[0];
+        p++;
+    }
+    // 请求体立即交给 HttpRequest，收到多少就归还多少窗口
+    if (frame.len > 0) {
+        WriteWindowUpdate(0, frame.len);
+    }
+    auto it = streams_.find(frame.stream_id);
+    if (it == streams_.end() || it->second.remote_closed) {
+        if (frame.stream_id > last_stream_id_) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        ResetStream(frame.stream_id, STREAM_CLOSED);
+        return true;
+    }
+    Stream &stream = it->second;
+    if (stream.body.size() + len > HttpRequest::MAX_INLINE_BODY) {
+        ResetStream(frame.stream_id, CANCEL);
+        return true;
+    }
+    stream.body.append(reinterpret_cast<const char *>(p), len);
+    if (frame.flags & FLAG_END_STREAM) {
+        stream.remote_closed = true;
+        StartRequest(frame.stream_id, stream);
+    } else if (frame.len > 0) {
+        WriteWindowUpdate(frame.stream_id, frame.len);
+    }
+    return true;
+}
+
+bool Http2Conn::OnSettings(const Frame &frame) {
+    if (frame.stream_id != 0) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+    }
+    if (frame.flags & FLAG_ACK) {
+        if (frame.len != 0) {
+            GoAway(FRAME_SIZE_ERROR);
+            return false;
+        }
+        return true;
+    }
+    if (frame.len % 6 != 0) {
+        GoAway(FRAME_SIZE_ERROR);
+        return false;
+    }
+    uint32_t error = ApplySettings(frame.payload, frame.len);
+    if (error != NO_ERROR) {
+        GoAway(error);
+        return false;
+    }
+    WriteFrameHeader(0, SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+// 返回错误码，成功时为 NO_ERROR
+uint32_t Http2Conn::ApplySettings(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        uint16_t id = (data[i] << 8) | data[i + 1];
+        uint32_t value = ReadU32(data + i + 2);
+        switch (id) {
+        case 0x1: // HEADER_TABLE_SIZE
+            encoder_.SetMaxTableSize(value);
+            break;
+        case 0x2: // ENABLE_PUSH
+            if (value > 1) {
+                return PROTOCOL_ERROR;
+            }
+            break;
+        case 0x4: { // INITIAL_WINDOW_SIZE，差值作用于所有已有的流
+            if (value > MAX_WINDOW) {
+                return FLOW_CONTROL_ERROR;
+            }
+            int64_t delta = static_cast<int64_t>(value) - initial_window_;
+            for (auto &item : streams_) {
+                item.second.window += delta;
+            }
+            initial_window_ = value;
+            break;
+        }
+        case 0x5: // MAX_FRAME_SIZE
+            if (value < DEFAULT_FRAME_SIZE || value > 0xffffff) {
+                return PROTOCOL_ERROR;
+            }
+            max_frame_size_ = value;
+            break;
+        default:
+            break;
+        }
+    }
+    return NO_ERROR;
+}
+
+bool Http2Conn::OnWindowUpdate(const Frame &frame) {
+    if (frame.len != 4) {
+        GoAway(FRAME_SIZE_ERROR);
+        return false;
+    }
+    uint32_t increment = ReadU32(frame.payload) & 0x7fffffff;
+    if (frame.stream_id == 0) {
+        conn_window_ += increment;
+        if (increment == 0 || conn_window_ > MAX_WINDOW) {
+            GoAway(increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+            return false;
+        }
+        return true;
+    }
+    auto it = streams_.find(frame.stream_id);
+    if (it == streams_.end()) {
+        if (frame.stream_id > last_stream_id_) {
+            GoAway(PROTOCOL_ERROR);
+            return false;
+        }
+        return true;
+    }
+    it->second.window += increment;
+    if (increment == 0 || it->second.window > MAX_WINDOW) {
+        ResetStream(frame.stream_id,
+                    increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+    }
+    return true;
+}
+
+// 把伪头部和头部还原成 HTTP/1.1 请求，由 HttpRequest 解析
+void Http2Conn::StartRequest(uint32_t stream_id, Stream &stream) {
+    string_view method, path, authority;
+    for (const HpackHeader &header : stream.headers) {
+        if (!SafeField(header.first) || !SafeField(header.second)) {
+            ResetStream(stream_id, PROTOCOL_ERROR);
+            return;
+        }
+        if (header.first == ":method") {
+            method = header.second;
+        } else if (header.first == ":path") {
+            path = header.second;
+        } else if (header.first == ":authority") {
+            authority = header.second;
+        }
+    }
+    if (method.empty() || path.empty() ||
+        method.find(' ') != string_view::npos ||
+        path.find(' ') != string_view::npos) {
+        ResetStream(stream_id, PROTOCOL_ERROR);
+        return;
+    }
+    req_buff_.RetrieveAll();
+    req_buff_.Append(method);
+    req_buff_.Append(" ", 1);
+    req_buff_.Append(path);
+    req_buff_.Append(" HTTP/1.1\r\n");
+    if (!authority.empty()) {
+        req_buff_.Append("Host: ");
+        req_buff_.Append(authority);
+        req_buff_.Append("\r\n", 2);
+    }
+    for (const HpackHeader &header : stream.headers) {
+        string_view name = header.first;
+        // 连接相关的头部在 HTTP/2 中没有意义，请求体长度由 DATA 帧决定
+        if (name.empty() || name[0] == ':' || name == "connection" ||
+            name == "keep-alive" || name == "content-length" ||
+            name == "transfer-encoding" || name == "upgrade" ||
+            name == "te" || (name == "host" && !authority.empty())) {
+            continue;
+        }
+        AppendCanonical(name, &req_buff_);
+        req_buff_.Append(": ", 2);
+        req_buff_.Append(header.second);
+        req_buff_.Append("\r\n", 2);
+    }
+    char line[64];
+    int len = snprintf(line, sizeof(line),
+                       "Connection: keep-alive\r\nContent-Length: %zu\r\n\r\n",
+                       stream.body.size());
+    req_buff_.Append(line, len);
+    req_buff_.Append(stream.body);
+    stream.headers.clear();
+    stream.body.clear();
+
+    request_.Init();
+    HttpRequest::PARSE_RESULT ret = request_.Pares(req_buff_);
+    Respond(stream_id, stream, request_, ret == HttpRequest::PARSE_COMPLETE);
+}
+
+// 生成响应并转成 HEADERS 和响应体片段，加入发送队列
+void Http2Conn::Respond(uint32_t stream_id, Stream &stream,
+                        HttpRequest &request, bool parsed) {
+    LOG_DEBUG("h2 stream %u %.*s", stream_id, (int)request.Path().size(),
+              request.Path().data());
+    HttpConn::InitResponse(request, parsed, &response_);
+    resp_buff_.RetrieveAll();
+    response_.MakeResponse(resp_buff_);
+    stream.file = response_.ReleaseFile();
+
+    const char *base = resp_buff_.Pullup(resp_buff_.ReadableBytes());
+    string_view all(base, resp_buff_.ReadableBytes());
+    size_t head_end = all.find("\r\n\r\n");
+    assert(head_end != string_view::npos);
+    // 跳过状态行，其余头部去掉连接相关的之后逐个编码
+    string_view lines = all.substr(0, head_end + 2);
+    lines.remove_prefix(lines.find("\r\n") + 2);
+    stream.status = response_.Code();
+    string name;
+    while (!lines.empty()) {
+        size_t eol = lines.find("\r\n");
+        string_view line = lines.substr(0, eol);
+        lines.remove_prefix(eol + 2);
+        size_t colon = line.find(':');
+        if (colon == string_view::npos) {
+            continue;
+        }
+        name.assign(line.data(), colon);
+        for (char &ch : name) {
+            ch = tolower(static_cast<unsigned char>(ch));
+        }
+        string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+        }
+        if (name == "connection" || name == "keep-alive") {
+            continue;
+        }
+        stream.response_headers.emplace_back(name, value);
+    }
+
+    // 响应体：头部之后缓冲区中的文本和文件片段按顺序交替
+    size_t pos = 0;
+    size_t body_start = head_end + 4;
+    auto add_text = [&](size_t begin, size_t end) {
+        begin = max(begin, body_start);
+        if (begin < end) {
+            size_t off = stream.text.size();
+            stream.text.append(base + begin, end - begin);
+            stream.pieces.push_back({false, off, stream.text.size()});
+        }
+    };
+    for (int i = 0; i < response_.SegmentCount(); i++) {
+        const HttpResponse::Segment &seg = response_.GetSegment(i);
+        add_text(pos, pos + seg.head_len);
+        pos += seg.head_len;
+        stream.pieces.push_back({true, seg.begin, seg.end});
+    }
+    add_text(pos, all.size());
+    ready_.push_back(stream_id);
+}
+
+size_t Http2Conn::PieceLeft(const Stream &stream) const {
+    const Piece &piece = stream.pieces[stream.piece];
+    return piece.end - piece.begin - stream.piece_off;
+}
+
+// 轮转发送：每轮每个流最多一个 DATA 帧，直到窗口用完、
+// 输出队列满或达到本次的写出预算
+void Http2Conn::Schedule() {
+    size_t budget = WRITE_BUDGET;
+    bool progress = true;
+    while (progress && budget > 0 && !ready_.empty()) {
+        progress = false;
+        for (size_t n = ready_.size(); n > 0 && budget > 0; n--) {
+            if (conn_->out_cnt_ >= HttpConn::OUT_SIZE - 1) {
+                return;
+            }
+            uint32_t stream_id = ready_.front();
+            ready_.pop_front();
+            auto it = streams_.find(stream_id);
+            if (it == streams_.end()) {
+                // 已被客户端取消
+                continue;
+            }
+            Stream &stream = it->second;
+            if (!stream.headers_sent) {
+                WriteHeaders(stream_id, stream);
+                progress = true;
+            }
+            if (stream.piece < stream.pieces.size()) {
+                int64_t window = min(stream.window, conn_window_);
+                size_t len = min(PieceLeft(stream), max_frame_size_);
+                if (window > 0) {
+                    len = min(len, static_cast<size_t>(window));
+                    WriteData(stream_id, stream, len);
+                    budget -= min(budget, len);
+                    progress = true;
+                }
+            }
+            if (stream.piece == stream.pieces.size()) {
+                streams_.erase(it);
+            } else {
+                ready_.push_back(stream_id);
+            }
+        }
+    }
+}
+
+// 编码之后立即写出，动态表的变化一定会到达客户端
+void Http2Conn::WriteHeaders(uint32_t stream_id, Stream &stream) {
+    head_block_.clear();
+    encoder_.Begin(&head_block_);
+    encoder_.EncodeStatus(stream.status, &head_block_);
+    for (auto &header : stream.response_headers) {
+        const string &name = header.first;
+        // 各响应间重复的头部加入动态表，之后只需一个字节；date 每秒变化，
+        // 加入只会挤掉其他条目
+        bool index = name == "content-type" || name == "vary" ||
+                     name == "accept-ranges" || name == "content-encoding";
+        encoder_.Encode(name, header.second, index, &head_block_);
+    }
+    uint8_t flags = stream.pieces.empty() ? FLAG_END_STREAM : 0;
+    string_view block = head_block_;
+    uint8_t type = HEADERS;
+    do {
+        size_t len = min(block.size(), max_frame_size_);
+        if (len == block.size()) {
+            flags |= FLAG_END_HEADERS;
+        }
+        WriteFrameHeader(len, type, flags, stream_id);
+        WriteRaw(block.data(), len);
+        block.remove_prefix(len);
+        type = CONTINUATION;
+        flags = 0;
+    } while (!block.empty());
+    stream.response_headers.clear();
+    stream.headers_sent = true;
+}
+
+// 文件片段直接作为输出项的文件部分，不拷贝
+void Http2Conn::WriteData(uint32_t stream_id, Stream &stream, size_t len) {
+    const Piece &piece = stream.pieces[stream.piece];
+    bool last = stream.piece + 1 == stream.pieces.size() &&
+                stream.piece_off + len == piece.end - piece.begin;
+    WriteFrameHeader(len, DATA, last ? FLAG_END_STREAM : 0, stream_id);
+    size_t begin = piece.begin + stream.piece_off;
+    if (piece.file) {
+        conn_->PushOutput(pending_, stream.file, begin, begin + len, true);
+        pending_ = 0;
+    } else {
+        WriteRaw(stream.text.data() + begin, len);
+    }
+    stream.piece_off += len;
+    if (stream.piece_off == piece.end - piece.begin) {
+        stream.piece++;
+        stream.piece_off = 0;
+    }
+    stream.window -= len;
+    conn_window_ -= len;
+}
+
+void Http2Conn::WriteFrameHeader(size_t len, uint8_t type, uint8_t flags,
+                                 uint32_t stream_id) {
+    uint8_t header[FRAME_HEADER_LEN];
+    header[0] = len >> 16;
+    header[1] = len >> 8;
+    header[2] = len;
+    header[3] = type;
+    header[4] = flags;
+    WriteU32(header + 5, stream_id);
+    WriteRaw(header, sizeof(header));
+}
+
+void Http2Conn::WriteRaw(const void *data, size_t len) {
+    conn_->write_buff_.Append(data, len);
+    pending_ += len;
+}
+
+// 服务端的连接前言
+void Http2Conn::WriteSettings() {
+    uint8_t payload[12];
+    payload[0] = 0;
+    payload[1] = 0x3; // MAX_CONCURRENT_STREAMS
+    WriteU32(payload + 2, MAX_STREAMS);
+    payload[6] = 0;
+    payload[7] = 0x6; // MAX_HEADER_LIST_SIZE，由 decoder_ 执行
+    WriteU32(payload + 8, HttpRequest::MAX_HEADER_SIZE);
+    WriteFrameHeader(sizeof(payload), SETTINGS, 0, 0);
+    WriteRaw(payload, sizeof(payload));
+    settings_sent_ = true;
+}
+
+void Http2Conn::WriteWindowUpdate(uint32_t stream_id, uint32_t increment) {
+    uint8_t payload[4];
+    WriteU32(payload, increment);
+    WriteFrameHeader(sizeof(payload), WINDOW_UPDATE, 0, stream_id);
+    WriteRaw(payload, sizeof(payload));
+}
+
+void Http2Conn::ResetStream(uint32_t stream_id, uint32_t error) {
+    uint8_t payload[4];
+    WriteU32(payload, error);
+    WriteFrameHeader(sizeof(payload), RST_STREAM, 0, stream_id);
+    WriteRaw(payload, sizeof(payload));
+    streams_.erase(stream_id);
+}
+
+// 连接错误：告知最后处理的流，写完后关闭连接
+void Http2Conn::GoAway(uint32_t error) {
+    LOG_WARN("Client[%d] HTTP/2 GOAWAY %u", conn_->fd_, error);
+    uint8_t payload[8];
+    WriteU32(payload, last_stream_id_);
+    WriteU32(payload + 4, error);
+    WriteFrameHeader(sizeof(payload), GOAWAY, 0, 0);
+    WriteRaw(payload, sizeof(payload));
+    goaway_ = true;
+    streams_.clear();
+    ready_.clear();
+    conn_->closing_ = true;
+}
+
+void Http2Conn::Flush() {
+    if (pending_ > 0) {
+        conn_->PushOutput(pending_, nullptr, 0, 0, true);
+        pending_ = 0;
+    }
+}
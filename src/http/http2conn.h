@@ -0,0 +1,168 @@
+#ifndef __HTTP2CONN_H__
+#define __HTTP2CONN_H__
+
+#include "../buffer/buffer.hpp"
+#include "../log/log.h"
+#include "filecache.h"
+#include "hpack.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class HttpConn;
+
+// HTTP/2 明文连接 (h2c) 的协议处理，由 HttpConn 在收到连接前言
+// (prior knowledge) 或完成 Upgrade: h2c 之后创建，之后接管 HttpConn 的
+// Process；读写、超时和事件分发仍由 HttpConn 和事件循环负责
+// 每个流的请求被还原成 HTTP/1.1 文本交给 HttpRequest 解析，响应由
+// HttpResponse 生成，头部转成 HPACK，响应体和 HTTP/1.1 一样取自 FileCache：
+// DATA 帧的帧头写在 write_buff_ 中，帧的内容是文件的一个片段，
+// 按偏移组成 iov 或用 sendfile 发送
+// 有响应的流按轮转顺序每次发一个 DATA 帧，受连接和流的发送窗口限制
+class Http2Conn {
+  public:
+    // 客户端连接前言
+    static constexpr std::string_view PREFACE =
+        "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    static const size_t MAX_STREAMS = 100;
+
+    explicit Http2Conn(HttpConn *conn);
+
+    // 读缓冲区开头是否为连接前言，数据不够判断时 partial 为 true
+    static bool HasPreface(const Buffer &buff, bool *partial);
+    // HTTP/1.1 请求是否要求升级到 h2c，带请求体的请求不升级
+    static bool WantsUpgrade(const HttpRequest &request);
+    // 在 write_buff_ 中写入 101 响应，request 作为流 1 的请求处理
+    void Upgrade(HttpRequest &request);
+    // 解析读缓冲区中的帧并生成输出，有待写出的数据时返回 true
+    bool Process();
+    // 连接空闲时释放还原请求、生成响应用的临时存储
+    void Release();
+    // 临时缓冲区和请求的 arena 持有的字节数
+    size_t HeldBytes() const {
+        return req_buff_.Capacity() + resp_buff_.Capacity() +
+               request_.HeldBytes();
+    }
+
+  private:
+    enum FRAME_TYPE {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9,
+    };
+    enum ERROR_CODE {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb,
+    };
+    static const uint8_t FLAG_END_STREAM = 0x1;
+    static const uint8_t FLAG_ACK = 0x1;
+    static const uint8_t FLAG_END_HEADERS = 0x4;
+    static const uint8_t FLAG_PADDED = 0x8;
+    static const uint8_t FLAG_PRIORITY = 0x20;
+    static const size_t FRAME_HEADER_LEN = 9;
+    static const size_t DEFAULT_FRAME_SIZE = 16384;
+    static const int64_t DEFAULT_WINDOW = 65535;
+    static const int64_t MAX_WINDOW = 0x7fffffff;
+    // 一次 Process 最多排队的响应体字节数，其余等这些写出后再生成
+    static const size_t WRITE_BUDGET = 256 * 1024;
+
+    struct Frame {
+        uint32_t len;
+        uint8_t type;
+        uint8_t flags;
+        uint32_t stream_id;
+        const uint8_t *payload;
+    };
+    // 响应体的一段，来自 text 或文件
+    struct Piece {
+        bool file;
+        size_t begin;
+        size_t end;
+    };
+    struct Stream {
+        int64_t window = DEFAULT_WINDOW; // 发送窗口
+        bool remote_closed = false;      // 收到 END_STREAM
+        bool headers_sent = false;
+        std::vector<HpackHeader> headers;
+        std::string body; // 请求体
+        // 响应，头部在写出 HEADERS 帧时才做 HPACK 编码：编码会改变动态表，
+        // 之前流被取消时块没有发出，两端的表就不再一致
+        int status = 0;
+        std::vector<HpackHeader> response_headers;
+        std::string text; // 响应体中不来自文件的部分
+        FileCache::EntryPtr file;
+        std::vector<Piece> pieces;
+        size_t piece = 0; // 当前发送的片段及其中已发送的字节数
+        size_t piece_off = 0;
+    };
+
+    bool HandleFrame(const Frame &frame);
+    bool OnHeaders(const Frame &frame);
+    bool OnHeaderBlock(uint32_t stream_id, bool end_stream);
+    bool OnData(const Frame &frame);
+    bool OnSettings(const Frame &frame);
+    uint32_t ApplySettings(const uint8_t *data, size_t len);
+    bool OnWindowUpdate(const Frame &frame);
+    void StartRequest(uint32_t stream_id, Stream &stream);
+    void Respond(uint32_t stream_id, Stream &stream, HttpRequest &request,
+                 bool parsed);
+    void Schedule();
+    void WriteHeaders(uint32_t stream_id, Stream &stream);
+    void WriteData(uint32_t stream_id, Stream &stream, size_t len);
+    void WriteFrameHeader(size_t len, uint8_t type, uint8_t flags,
+                          uint32_t stream_id);
+    void WriteRaw(const void *data, size_t len);
+    void WriteSettings();
+    void WriteWindowUpdate(uint32_t stream_id, uint32_t increment);
+    void ResetStream(uint32_t stream_id, uint32_t error);
+    void GoAway(uint32_t error);
+    void Flush();
+    size_t PieceLeft(const Stream &stream) const;
+
+    HttpConn *conn_;
+    bool preface_received_;
+    bool settings_sent_;
+    bool goaway_;
+    // 写入 write_buff_ 但还没有归入输出项的字节数
+    size_t pending_;
+    uint32_t last_stream_id_;
+    int64_t conn_window_;
+    size_t max_frame_size_; // 对端的 SETTINGS_MAX_FRAME_SIZE
+    int64_t initial_window_;
+    // 未结束的头部块，等待 CONTINUATION
+    uint32_t continuation_id_;
+    bool continuation_end_stream_;
+    std::string header_block_;
+    std::unordered_map<uint32_t, Stream> streams_;
+    std::deque<uint32_t> ready_; // 有响应待发送的流，按轮转顺序
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    std::string head_block_; // 编码后的响应头部块
+    // 还原出的 HTTP/1.1 请求和响应头的临时缓冲区
+    Buffer req_buff_;
+    Buffer resp_buff_;
+    HttpRequest request_;
+    HttpResponse response_;
+};
+
+#endif //__HTTP2CONN_H__
@@ -6,11 +6,28 @@ using namespace std;
 const char *HttpConn::src_dir_;
 std::atomic<int> HttpConn::user_count_;
 bool HttpConn::is_ET_;
+std::atomic<int> HttpConn::state_conns_[STATE_COUNT];
+std::atomic<size_t> HttpConn::state_bytes_[STATE_COUNT];
 
+// 缓冲区在第一次读写时才取得
 HttpConn::HttpConn() {
     fd_ = -1;
+    gen_ = 0;
+    pending_ = 0;
+    done_ = 0;
+    owned_ = false;
+    read_paused_ = false;
+    closing_ = false;
+    started_ = false;
+    out_head_ = 0;
+    out_cnt_ = 0;
+    to_write_ = 0;
+    state_ = IDLE;
+    held_ = 0;
     addr_ = {0};
     is_close_ = true;
+    // 连接对象在连接表中的位置固定，sink 一直有效
+    request_.SetBodySink(&body_sink_);
 };
 
 HttpConn::~HttpConn() { Close(); };
@@ -19,26 +36,107 @@ HttpConn::~HttpConn() { Close(); };
 void HttpConn::Init(int fd, const sockaddr_in &addr) {
     assert(fd > 0);
     user_count_++;
+    gen_.fetch_add(1, std::memory_order_relaxed);
+    pending_ = 0;
+    done_ = 0;
+    owned_ = false;
+    read_paused_ = false;
+    closing_ = false;
+    started_ = false;
+    ClearOutput();
+    h2_.reset();
     addr_ = addr;
     fd_ = fd;
+    if (TlsContext::Instance()->Enabled()) {
+        tls_.reset(TlsContext::Instance()->NewConn(fd_));
+    }
     write_buff_.RetrieveAll();
     read_buff_.RetrieveAll();
+    request_.Init();
+    state_ = IDLE;
+    held_ = 0;
+    state_conns_[IDLE].fetch_add(1, std::memory_order_relaxed);
     is_close_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(),
              (int)user_count_);
 }
 
 void HttpConn::Close() {
-    response_.UnmapFile();
-    if (is_close_ == false) {
+    ClearOutput();
+    h2_.reset();
+    bool open = !is_close_;
+    if (open && tls_) {
+        tls_->Shutdown();
+    }
+    tls_.reset();
+    // 关闭的连接留在连接表中，不再持有缓冲区
+    read_buff_.Release();
+    write_buff_.Release();
+    request_.Release();
+    response_.Release();
+    if (open) {
         is_close_ = true;
         user_count_--;
-        close(fd_);
+        state_conns_[state_].fetch_sub(1, std::memory_order_relaxed);
+        state_bytes_[state_].fetch_sub(held_, std::memory_order_relaxed);
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(),
                  GetPort(), (int)user_count_);
+        // fd 关闭后可能立即被新连接复用，另一个线程会 Init 这个对象，
+        // 所以 close 之后不能再访问它
+        close(fd_);
     }
 }
 
+const char *HttpConn::StateName(int state) {
+    static const char *NAMES[STATE_COUNT] = {"idle", "reading", "writing"};
+    return NAMES[state];
+}
+
+size_t HttpConn::HeldBytes() const {
+    size_t held = read_buff_.Capacity() + write_buff_.Capacity() +
+                  request_.HeldBytes();
+    if (h2_) {
+        held += h2_->HeldBytes();
+    }
+    return held;
+}
+
+// 保持连接的客户端大部分时间没有请求，这时缓冲区都是空的；
+// 交还之后空闲连接不占用缓冲区，处理大请求时扩大的缓冲区也随之释放
+// HTTP/2 连接上等待窗口的流不受影响，它们的数据不在缓冲区中
+void HttpConn::Settle() {
+    int state = IDLE;
+    if (to_write_ > 0 || out_cnt_ > 0) {
+        state = WRITING;
+    } else if (read_buff_.ReadableBytes() > 0) {
+        state = READING;
+    } else {
+        assert(write_buff_.ReadableBytes() == 0);
+        read_buff_.Release();
+        write_buff_.Release();
+        request_.Release();
+        response_.Shrink();
+        if (h2_) {
+            h2_->Release();
+        }
+    }
+    SetState(state, HeldBytes());
+}
+
+void HttpConn::SetState(int state, size_t held) {
+    if (state == state_ && held == held_) {
+        return;
+    }
+    if (state != state_) {
+        state_conns_[state_].fetch_sub(1, std::memory_order_relaxed);
+        state_conns_[state].fetch_add(1, std::memory_order_relaxed);
+    }
+    state_bytes_[state_].fetch_sub(held_, std::memory_order_relaxed);
+    state_bytes_[state].fetch_add(held, std::memory_order_relaxed);
+    state_ = state;
+    held_ = held;
+}
+
 int HttpConn::GetFd() const { return fd_; };
 
 struct sockaddr_in HttpConn::GetAddr() const { return addr_; }
@@ -48,73 +146,315 @@ const char *HttpConn::GetIP() const { return inet_ntoa(addr_.sin_addr); }
 int HttpConn::GetPort() const { return addr_.sin_port; }
 
 // 从 fd 中读取内容到缓冲区 read_buff_
+// 缓冲区超过 READ_HIGH_WATER 时暂停读取，等解析消费之后再继续，
+// 这时返回值大于 0 且 IsReadPaused() 为 true
+// TLS 连接每次读取解密一个记录，握手期间没有数据可读
 ssize_t HttpConn::Read(int *saveErrno) {
     ssize_t len = -1;
+    read_paused_ = false;
     do {
-        len = read_buff_.ReadFd(fd_, saveErrno);
+        len = tls_ ? tls_->Read(&read_buff_, saveErrno)
+                   : read_buff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
+        if (read_buff_.ReadableBytes() >= READ_HIGH_WATER) {
+            read_paused_ = true;
+            break;
+        }
     } while (is_ET_);
     return len;
 }
 
-// 将 iov 中的内容写入到 fd 中
+void HttpConn::Receive(const char *data, size_t len) {
+    read_buff_.Append(data, len);
+}
+
+// 将排队的响应写入到 fd 中，每次 writev 尽量带上队列中的所有响应，
+// 大文件的内容用 sendfile 发送
+// TLS 连接在内核接管加密 (kTLS) 之后同样直接写 socket
 ssize_t HttpConn::Write(int *saveErrno) {
+    if (tls_ && !tls_->KernelSend()) {
+        return WriteTls(saveErrno);
+    }
     ssize_t len = -1;
     do {
-        len = writev(fd_, iov_, iov_cnt_);
+        const Output &front = out_[out_head_];
+        if (front.buff_len == 0 && IsSendfile(front)) {
+            // 内核直接从页缓存发送，不经过用户态，也不会在本线程缺页
+            off_t off = front.file_off;
+            len = sendfile(fd_, front.file->fd, &off,
+                           front.file_end - front.file_off);
+            if (len == 0) {
+                // 文件在发送期间被截断
+                errno = EIO;
+                len = -1;
+            }
+        } else {
+            len = WriteIov();
+        }
         if (len <= 0) {
             *saveErrno = errno;
             break;
         }
-        if (iov_[0].iov_len + iov_[1].iov_len == 0) {
+        Consume(len);
+        if (to_write_ == 0) {
             break;
-        } else if (static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base =
-                (uint8_t *)iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if (iov_[0].iov_len) {
-                write_buff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
-        } else {
-            iov_[0].iov_base = (uint8_t *)iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            write_buff_.Retrieve(len);
         }
     } while (is_ET_ || ToWriteBytes() > 10240);
     return len;
 }
 
-bool HttpConn::Process() {
-    // 前面已经将 fd 的请求内容写入到了 read_buff_ 中
-    request_.Init();
-    if (read_buff_.ReadableBytes() <= 0) {
-        return false;
-    } else if (request_.Pares(read_buff_)) {
-        LOG_DEBUG("%s", request_.Path().c_str());
-        response_.Init(src_dir_, request_.Path(), request_.IsKeepAlive(), 200);
-    } else {
-        response_.Init(src_dir_, request_.Path(), false, 400);
+// 从队首开始把 write_buff_ 中的数据和映射的文件组成 iov 一次写出，
+// 遇到用 sendfile 发送的文件时停在它前面
+// write_buff_ 中的数据按块导出，同一块中相邻响应的头部合并成一项；
+// iov 用完时只写出已放入的部分
+ssize_t HttpConn::WriteIov() {
+    struct iovec iov[WRITE_IOV];
+    int iov_cnt = 0;
+    size_t buff_off = 0;
+    bool more = false;
+    for (int i = 0; i < out_cnt_; i++) {
+        const Output &out = out_[(out_head_ + i) & OUT_MASK];
+        if (write_buff_.AppendIov(buff_off, out.buff_len, iov, &iov_cnt,
+                                  WRITE_IOV) < out.buff_len) {
+            break;
+        }
+        buff_off += out.buff_len;
+        if (out.file_off >= out.file_end) {
+            continue;
+        }
+        if (IsSendfile(out)) {
+            more = true;
+            break;
+        }
+        if (iov_cnt == WRITE_IOV) {
+            break;
+        }
+        iov[iov_cnt].iov_base =
+            const_cast<char *>(out.file->data) + out.file_off;
+        iov[iov_cnt].iov_len = out.file_end - out.file_off;
+        iov_cnt++;
+    }
+    if (!more) {
+        return writev(fd_, iov, iov_cnt);
+    }
+    // 后面紧跟 sendfile，MSG_MORE 让头部和文件开头合并到同一个报文中
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_cnt;
+    return sendmsg(fd_, &msg, MSG_MORE);
+}
+
+// 内核不支持 kTLS 时在用户态加密：每次把队首开始的数据拼成一个记录，
+// 头部和小响应合并在同一个记录中
+ssize_t HttpConn::WriteTls(int *saveErrno) {
+    ssize_t len = -1;
+    do {
+        char record[TlsConn::RECORD_SIZE];
+        size_t n = FillRecord(record, sizeof(record));
+        if (n == 0) {
+            // 文件在发送期间被截断
+            *saveErrno = EIO;
+            return -1;
+        }
+        // 上次写不完时重试的数据开头不变，之后新排队的响应只会使它变长
+        len = tls_->Write(record, n, saveErrno);
+        if (len <= 0) {
+            break;
+        }
+        Consume(len);
+        if (to_write_ == 0) {
+            break;
+        }
+    } while (is_ET_ || ToWriteBytes() > 10240);
+    return len;
+}
+
+// 从队首开始把最多 size 字节待写出的数据拷贝到 record 中，
+// sendfile 发送的文件用 pread 读出，读取出错时返回 0
+size_t HttpConn::FillRecord(char *record, size_t size) {
+    size_t buff_off = 0;
+    size_t n = 0;
+    for (int i = 0; i < out_cnt_ && n < size; i++) {
+        const Output &out = out_[(out_head_ + i) & OUT_MASK];
+        size_t len = std::min(out.buff_len, size - n);
+        write_buff_.CopyOut(buff_off, record + n, len);
+        buff_off += out.buff_len;
+        n += len;
+        len = std::min(out.file_end - out.file_off, size - n);
+        if (len == 0) {
+            continue;
+        }
+        if (IsSendfile(out)) {
+            ssize_t ret = pread(out.file->fd, record + n, len, out.file_off);
+            if (ret != static_cast<ssize_t>(len)) {
+                return 0;
+            }
+        } else {
+            memcpy(record + n, out.file->data + out.file_off, len);
+        }
+        n += len;
     }
+    return n;
+}
 
-    // 将响应内容写入到 write_buff_ 中
+// 已写出 len 字节，从队首开始消费
+void HttpConn::Consume(size_t len) {
+    assert(len <= to_write_);
+    to_write_ -= len;
+    while (len > 0) {
+        Output &out = out_[out_head_];
+        size_t n = std::min(len, out.buff_len);
+        write_buff_.Retrieve(n);
+        out.buff_len -= n;
+        len -= n;
+        n = std::min(len, out.file_end - out.file_off);
+        out.file_off += n;
+        len -= n;
+        if (out.buff_len > 0 || out.file_off < out.file_end) {
+            break;
+        }
+        PopOutput();
+    }
+}
+
+// 按响应的文件片段排队，各片段共享同一个缓存项
+void HttpConn::PushResponse() {
+    FileCache::EntryPtr file = response_.ReleaseFile();
+    int n = response_.SegmentCount();
+    for (int i = 0; i < n; i++) {
+        const HttpResponse::Segment &seg = response_.GetSegment(i);
+        bool last = i == n - 1 && response_.TailLen() == 0;
+        PushOutput(seg.head_len, file, seg.begin, seg.end, last);
+    }
+    if (n == 0 || response_.TailLen() > 0) {
+        PushOutput(response_.TailLen(), nullptr, 0, 0, true);
+    }
+}
 
-    response_.MakeResponse(write_buff_);
+// last 表示 buff_len 之后 write_buff_ 中没有更多数据
+void HttpConn::PushOutput(size_t buff_len, const FileCache::EntryPtr &file,
+                          size_t begin, size_t end, bool last) {
+    assert(out_cnt_ < OUT_SIZE);
+    Output &out = out_[(out_head_ + out_cnt_) & OUT_MASK];
+    out.buff_len = buff_len;
+    out.file_off = begin;
+    out.file_end = end;
+    // 小文件直接拷贝到头部后面，和相邻的响应合并成一个 iov
+    if (last && file && file->data && end - begin <= INLINE_MAX) {
+        write_buff_.Append(file->data + begin, end - begin);
+        out.buff_len += end - begin;
+        out.file_off = out.file_end = 0;
+    } else if (begin < end) {
+        out.file = file;
+    }
+    out_cnt_++;
+    to_write_ += out.buff_len + (out.file_end - out.file_off);
+}
 
-    // 将 iov 指向 write_buff_ , 后面直接使用 writev 写入到 fd 中
-    iov_[0].iov_base = const_cast<char *>(write_buff_.Peek());
-    iov_[0].iov_len = write_buff_.ReadableBytes();
-    iov_cnt_ = 1;
+void HttpConn::PopOutput() {
+    assert(out_cnt_ > 0);
+    out_[out_head_].file.reset();
+    out_head_ = (out_head_ + 1) & OUT_MASK;
+    out_cnt_--;
+    if (out_cnt_ == 0) {
+        write_buff_.RetrieveAll();
+    }
+}
 
-    // 将文件写入映射到 iov 中
-    if (response_.FileLen() > 0 && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iov_cnt_ = 2;
+void HttpConn::ClearOutput() {
+    while (out_cnt_ > 0) {
+        PopOutput();
+    }
+    out_head_ = 0;
+    to_write_ = 0;
+    write_buff_.RetrieveAll();
+    response_.ClearFile();
+}
+
+void HttpConn::InitResponse(HttpRequest &request, bool parsed,
+                            HttpResponse *response) {
+    if (!parsed) {
+        response->Init(src_dir_, request.Path(), false, request.ErrorCode());
+        return;
+    }
+    int accept = HttpResponse::AcceptEncoding(
+        request.GetHeader(HttpRequest::HDR_ACCEPT_ENCODING));
+    response->Init(src_dir_, request.Path(), request.IsKeepAlive(), 200,
+                   accept);
+    if (request.Method() == "GET" || request.Method() == "HEAD") {
+        response->SetConditional(
+            request.GetHeader(HttpRequest::HDR_IF_NONE_MATCH),
+            request.GetHeader(HttpRequest::HDR_IF_MODIFIED_SINCE));
+    }
+    if (request.Method() == "GET") {
+        response->SetRange(request.GetHeader(HttpRequest::HDR_RANGE),
+                           request.GetHeader(HttpRequest::HDR_IF_RANGE));
+    }
+    if (request.Method() == "HEAD") {
+        response->OmitBody();
+    }
+}
+
+bool HttpConn::Process() {
+    if (h2_) {
+        return h2_->Process();
+    }
+    // 前面已经将 fd 的请求内容写入到了 read_buff_ 中
+    // 客户端可能一次发来多个请求 (pipelining)，逐个解析并把响应排队，
+    // 之后由一次 writev 写出；要求关闭连接的响应之后不再解析
+    while (out_cnt_ < MAX_PIPELINE && !closing_ &&
+           read_buff_.ReadableBytes() > 0) {
+        // 以 HTTP/2 连接前言开头的连接 (prior knowledge)，只检查连接最初的
+        // 数据，已经开始处理 HTTP/1.1 请求的连接不能中途切换
+        if (!started_) {
+            bool partial;
+            if (Http2Conn::HasPreface(read_buff_, &partial)) {
+                h2_.reset(new Http2Conn(this));
+                return h2_->Process();
+            }
+            if (partial) {
+                break;
+            }
+            started_ = true;
+        }
+        HttpRequest::PARSE_RESULT ret = request_.Pares(read_buff_);
+        if (ret == HttpRequest::PARSE_INCOMPLETE) {
+            // 请求还不完整，解析进度保留在 request_ 中，等读到更多数据
+            break;
+        }
+        bool parsed = ret == HttpRequest::PARSE_COMPLETE;
+        if (parsed) {
+            LOG_DEBUG("%.*s", (int)request_.Path().size(),
+                      request_.Path().data());
+            // h2c 只用于明文连接，TLS 上的 HTTP/2 由 ALPN 协商
+            if (!tls_ && Http2Conn::WantsUpgrade(request_)) {
+                // 101 之后的数据都是 HTTP/2 帧，这个请求的响应在流 1 上
+                h2_.reset(new Http2Conn(this));
+                h2_->Upgrade(request_);
+                read_buff_.Retrieve(request_.Length());
+                return h2_->Process();
+            }
+        }
+        InitResponse(request_, parsed, &response_);
+
+        // 将响应的状态行和头部追加到 write_buff_ 中
+        response_.MakeResponse(write_buff_);
+        PushResponse();
+        if (!parsed || !request_.IsKeepAlive()) {
+            closing_ = true;
+        }
+
+        // 请求中的 string_view 指向 read_buff_，响应生成之后才能消费
+        if (parsed) {
+            read_buff_.Retrieve(request_.Length());
+        } else {
+            read_buff_.RetrieveAll();
+        }
+        LOG_DEBUG("%d response queued, %d bytes to write", out_cnt_,
+                  (int)to_write_);
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen(), iov_cnt_,
-              ToWriteBytes());
-    return true;
+    return to_write_ > 0;
 }
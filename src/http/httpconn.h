@@ -1,18 +1,38 @@
 #ifndef __HTTPCONN_H__
 #define __HTTPCONN_H__
 
-#include "../buffer/buffer.h"
+#include "../buffer/buffer.hpp"
 #include "../log/log.h"
+#include "../pool/mpscqueue.hpp"
 #include "../pool/sqlconnRAII.h"
+#include "../timer/timingwheel.h"
+#include "formdecoder.h"
+#include "http2conn.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "tlsconn.h"
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <error.h>
+#include <memory>
 #include <stdlib.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
-class HttpConn {
+// 对齐到缓存行，热字段 (fd、状态、写出进度) 放在对象开头的同一缓存行中，
+// 每次事件分发只访问这一行；地址、缓冲区和请求/响应对象放在后面
+class alignas(64) HttpConn : public MpscNode {
   public:
+    // 连接在两次事件处理之间所处的状态
+    enum CONN_STATE {
+        IDLE,    // 响应已写完且读缓冲区为空，缓冲区已交还
+        READING, // 读缓冲区中有未处理完的请求
+        WRITING, // 有响应等待写出
+        STATE_COUNT,
+    };
+
     HttpConn();
 
     ~HttpConn();
@@ -21,43 +41,165 @@ class HttpConn {
 
     ssize_t Read(int *saveErrno);
 
+    // 追加由 Poller 完成读取的数据
+    void Receive(const char *data, size_t len);
+    // 读缓冲区中尚未处理的字节数
+    size_t ReadBytes() const { return read_buff_.ReadableBytes(); }
+
     ssize_t Write(int *saveErrno);
 
     void Close();
 
     int GetFd() const;
 
+    bool IsClose() const { return is_close_; }
+
+    // 每次 Init 递增，用来识别 fd 被复用之前的过期事件和定时器
+    uint32_t Gen() const { return gen_.load(std::memory_order_relaxed); }
+
+    // 以下状态只由所属事件循环访问
+    // 连接交给工作线程处理期间为 owned，这时到来的事件记录在 pending 中，
+    // 等工作线程交回连接后再处理
+    bool IsOwned() const { return owned_; }
+    void SetOwned(bool owned) { owned_ = owned; }
+    void AddPending(uint32_t events) { pending_ |= events; }
+    uint32_t TakePending() {
+        uint32_t events = pending_;
+        pending_ = 0;
+        return events;
+    }
+
+    // 工作线程交回连接时附带的处理结果
+    int Done() const { return done_; }
+    void SetDone(int done) { done_ = done; }
+
+    // 超时定时器节点，由所属事件循环的时间轮使用
+    TimerNode *Timer() { return &timer_; }
+
     int GetPort() const;
 
     const char *GetIP() const;
 
     sockaddr_in GetAddr() const;
 
+    // 解析读缓冲区中所有完整的请求，响应按顺序排队，有待写出的响应时返回 true
     bool Process();
 
-    int ToWriteBytes() { return iov_[0].iov_len + iov_[1].iov_len; }
+    size_t ToWriteBytes() const { return to_write_; }
+
+    // 每次事件处理结束时在处理连接的线程中调用：连接空闲时把读写缓冲区
+    // 和请求的 arena 交还给块池，下次可读时再取得，响应中为大请求增长的
+    // 路径也释放；之后更新状态统计
+    void Settle();
+    // 连接的缓冲区和请求的 arena 持有的字节数
+    size_t HeldBytes() const;
 
-    bool IsKeepAlive() const { return request_.IsKeepAlive(); }
+    // 已排队的响应中没有要求关闭连接的
+    bool IsKeepAlive() const { return !closing_; }
+
+    // 上次读取因缓冲区达到高水位而暂停，socket 中可能还有数据
+    bool IsReadPaused() const { return read_paused_; }
+
+    // 读缓冲区的高水位，需大于请求头和内联请求体的上限之和
+    static const size_t READ_HIGH_WATER = 128 * 1024;
+    // 每个连接最多排队的输出项数，达到后剩余的请求留在读缓冲区中，
+    // 等前面的响应写出后再解析；普通响应占一项，
+    // multipart/byteranges 响应每个范围一项，另加结尾一项
+    static const int MAX_PIPELINE = 16;
+    // 不超过这个大小的文件拷贝到写缓冲区中和头部一起发送
+    static const size_t INLINE_MAX = 4096;
 
     // static 变量， 所有对象共享
     static bool is_ET_;
     static const char *src_dir_;
     static std::atomic<int> user_count_;
 
+    // 各状态的连接数和它们持有的缓冲区字节数，可在任意线程读取
+    static int StateConns(int state) {
+        return state_conns_[state].load(std::memory_order_relaxed);
+    }
+    static size_t StateBytes(int state) {
+        return state_bytes_[state].load(std::memory_order_relaxed);
+    }
+    static const char *StateName(int state);
+
   private:
+    // HTTP/2 连接复用输出队列和缓冲区
+    friend class Http2Conn;
+
+    // 已生成、等待写出的输出项：一段 write_buff_ 中的数据，
+    // 之后是文件的 [file_off, file_end)
+    struct Output {
+        size_t buff_len; // 在 write_buff_ 中还未写出的字节数
+        // 文件内容，持有引用直到写完，缓存淘汰不会影响正在发送的响应
+        // 小文件已拷贝到 write_buff_ 中，这时为空
+        FileCache::EntryPtr file;
+        // 下一个要写出的文件偏移，直接用作 iov 或 sendfile 的偏移
+        size_t file_off;
+        size_t file_end;
+    };
+    // 队列容量，一个 multipart 响应最多 MAX_RANGES + 1 项
+    static const int OUT_SIZE = 2 * MAX_PIPELINE;
+    static const int OUT_MASK = OUT_SIZE - 1;
+    // 一次 writev 最多的 iov 项数，write_buff_ 的每块和每个文件各占一项
+    static const int WRITE_IOV = 64;
+    static_assert(OUT_SIZE >= MAX_PIPELINE + HttpResponse::MAX_RANGES &&
+                      (OUT_SIZE & OUT_MASK) == 0,
+                  "OUT_SIZE must be a power of 2");
+    // 按解析结果初始化响应，HTTP/1.1 的请求和 HTTP/2 的流共用
+    static void InitResponse(HttpRequest &request, bool parsed,
+                             HttpResponse *response);
+    void PushResponse();
+    void PushOutput(size_t buff_len, const FileCache::EntryPtr &file,
+                    size_t begin, size_t end, bool last);
+    void PopOutput();
+    void ClearOutput();
+    void Consume(size_t len);
+    ssize_t WriteIov();
+    ssize_t WriteTls(int *saveErrno);
+    size_t FillRecord(char *record, size_t size);
+    static bool IsSendfile(const Output &out) {
+        return out.file && out.file->fd >= 0;
+    }
+    void SetState(int state, size_t held);
+
+    // 热数据
     int fd_;
-    struct sockaddr_in addr_;
-
+    std::atomic<uint32_t> gen_;
+    uint32_t pending_;
+    int done_;
+    bool owned_;
+    bool read_paused_;
+    bool closing_;
+    bool started_; // 已开始解析 HTTP/1.1 请求，不再检查 HTTP/2 连接前言
     bool is_close_;
-
-    int iov_cnt_;
-    struct iovec iov_[2];
-
+    // 响应队列，out_[out_head_] 开始的 out_cnt_ 项
+    int out_head_;
+    int out_cnt_;
+    size_t to_write_;
+    TimerNode timer_;
+
+    // 冷数据
+    // 上次 Settle 时的状态和持有的字节数，已计入统计
+    int state_;
+    size_t held_;
+    struct sockaddr_in addr_;
     Buffer read_buff_;  // 读缓冲区
-    Buffer write_buff_; // 写缓冲区
+    Buffer write_buff_; // 写缓冲区，按顺序存放排队响应的状态行和头部
+    Output out_[OUT_SIZE];
 
     HttpRequest request_;
+    // 接收 request_ 中超过内联上限的请求体
+    FormSink body_sink_;
     HttpResponse response_;
+    // 升级到 HTTP/2 之后由它处理读缓冲区中的帧
+    std::unique_ptr<Http2Conn> h2_;
+    // 启用 TLS 时的连接状态，读写都经过它
+    std::unique_ptr<TlsConn> tls_;
+
+    // 状态只在变化时更新，空闲连接处理完一个请求又回到空闲时不写计数
+    static std::atomic<int> state_conns_[STATE_COUNT];
+    static std::atomic<size_t> state_bytes_[STATE_COUNT];
 };
 
 #endif //__HTTPCONN_H__
\ No newline at end of file
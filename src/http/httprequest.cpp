@@ -1,69 +1,423 @@
 #include "httprequest.h"
+#include "formdecoder.h"
 
-const std::unordered_set<std::string> HttpRequest::default_html{
+const std::unordered_set<std::string_view> HttpRequest::default_html{
     "/index", "/register", "/login", "/welcome", "/video", "/picture",
 };
 
-const std::unordered_map<std::string, int> HttpRequest::default_html_tag{
+const std::unordered_map<std::string_view, int>
+    HttpRequest::default_html_tag{
     {"/register.html", 0},
     {"/login.html", 1},
 };
 
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
     state_ = REQUEST_LINE;
-    header_.clear();
-    post_.clear();
+    pos_ = line_start_ = length_ = 0;
+    head_len_ = body_left_ = body_size_ = 0;
+    keep_alive_ = streaming_ = form_ = false;
+    error_code_ = 400;
+    method_span_ = path_span_ = version_span_ = Span{0, 0};
+    method_ = version_ = body_ = std::string_view();
+    base_ = nullptr;
+    memset(known_, 0, sizeof(known_));
+    // clear 会保留 arena_ 中的存储，换成空的容器之后才能回收
+    decltype(headers_)(&arena_).swap(headers_);
+    decltype(path_)(&arena_).swap(path_);
+    decltype(inline_body_)(&arena_).swap(inline_body_);
+    decltype(post_)(&arena_).swap(post_);
+    arena_.Reset();
 }
 
-bool HttpRequest::IsKeepAlive() const {
-    if (header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" &&
-               version_ == "1.1";
+void HttpRequest::Release() {
+    Init();
+    arena_.Release();
+}
+
+bool HttpRequest::IsKeepAlive() const { return keep_alive_; }
+
+// 请求的内容已经写入到缓冲区中，从上次停下的位置继续解析
+HttpRequest::PARSE_RESULT HttpRequest::Pares(Buffer &buff) {
+    if (state_ == FINISH) {
+        Init();
+    }
+    bool ok = true;
+    if (state_ == REQUEST_LINE || state_ == HEADERS) {
+        ok = ParseLines(buff) != PARSE_ERROR;
+    }
+    if (ok && state_ != REQUEST_LINE && state_ != HEADERS &&
+        state_ != FINISH) {
+        ok = ParseBody(buff);
+    }
+    if (!ok) {
+        keep_alive_ = false;
+        state_ = FINISH;
+        return PARSE_ERROR;
+    }
+    if (state_ != FINISH) {
+        return PARSE_INCOMPLETE;
+    }
+    Finish(buff.Peek());
+    LOG_DEBUG("[%.*s], [%s], [%.*s]", (int)method_.size(), method_.data(),
+              path_.c_str(), (int)version_.size(), version_.data());
+    return PARSE_COMPLETE;
+}
+
+// 逐行解析请求行和头部，直到空行或数据用完
+// 在第一块中扫描，行跨越块的边界时把头部上限以内的数据移到第一块中
+HttpRequest::PARSE_RESULT HttpRequest::ParseLines(Buffer &buff) {
+    const char *base = buff.Peek();
+    size_t avail = buff.ContiguousBytes();
+    size_t readable = buff.ReadableBytes();
+    while (state_ == REQUEST_LINE || state_ == HEADERS) {
+        const char *limit = base + avail;
+        const char *crlf = Scan::FindCRLF(base + pos_, limit);
+        if (crlf == limit && avail < readable && avail < MAX_HEADER_SIZE) {
+            base = buff.Pullup(readable < MAX_HEADER_SIZE ? readable
+                                                          : MAX_HEADER_SIZE);
+            avail = buff.ContiguousBytes();
+            continue;
+        }
+        if (crlf == limit) {
+            // 行还不完整，下次从这里继续扫描，最后一个字节可能是 '\r'
+            pos_ = avail > line_start_ ? avail - 1 : line_start_;
+            size_t limit = state_ == REQUEST_LINE ? MAX_LINE : MAX_HEADER_SIZE;
+            size_t used = state_ == REQUEST_LINE ? readable - line_start_
+                                                 : readable;
+            if (used > limit) {
+                LOG_WARN("Request header too large");
+                return PARSE_ERROR;
+            }
+            return PARSE_INCOMPLETE;
+        }
+        size_t end = crlf - base;
+        pos_ = end + 2;
+        Span line{static_cast<uint32_t>(line_start_),
+                  static_cast<uint32_t>(end - line_start_)};
+        line_start_ = pos_;
+        if (pos_ > MAX_HEADER_SIZE) {
+            LOG_WARN("Request header too large");
+            return PARSE_ERROR;
+        }
+        if (state_ == REQUEST_LINE) {
+            if (line.len == 0) {
+                // 请求行之前的空行
+                continue;
+            }
+            if (line.len > MAX_LINE || !ParseRequestLine(base, line)) {
+                return PARSE_ERROR;
+            }
+            // arena_ 中的分配不能就地扩大，一次留出常见数量的头部
+            headers_.reserve(COMMON_HEADERS);
+            state_ = HEADERS;
+        } else if (line.len == 0) {
+            // 头部结束
+            if (!ParseFraming(base)) {
+                return PARSE_ERROR;
+            }
+        } else if (!ParseHeader(base, line)) {
+            return PARSE_ERROR;
+        }
+    }
+    return PARSE_INCOMPLETE;
+}
+
+// method SP request-target SP HTTP/version，方法必须是 token
+bool HttpRequest::ParseRequestLine(const char *base, Span line) {
+    std::string_view str = View(base, line);
+    size_t sp1 = Scan::FindNonToken(str.data(), str.data() + str.size()) -
+                 str.data();
+    size_t sp2 = sp1 < str.size() ? str.find(' ', sp1 + 1) : sp1;
+    if (sp1 == 0 || sp1 == str.size() || str[sp1] != ' ' ||
+        sp2 == std::string_view::npos || sp2 == sp1 + 1 ||
+        str.compare(sp2 + 1, 5, "HTTP/") != 0 ||
+        str.find(' ', sp2 + 1) != std::string_view::npos) {
+        LOG_ERROR("Requestline error");
+        return false;
     }
-    return false;
+    method_span_ = Span{line.off, static_cast<uint32_t>(sp1)};
+    path_span_ = Span{static_cast<uint32_t>(line.off + sp1 + 1),
+                      static_cast<uint32_t>(sp2 - sp1 - 1)};
+    version_span_ = Span{static_cast<uint32_t>(line.off + sp2 + 6),
+                         static_cast<uint32_t>(line.len - sp2 - 6)};
+    return true;
 }
 
-// 请求的内容已经写入到缓冲区中，解析缓冲区中的请求内容。
-bool HttpRequest::Pares(Buffer &buff) {
-    const char CRLF[] = "\r\n";
-    if (buff.ReadableBytes() <= 0) {
+// name: OWS value OWS，头部名必须是 token 且紧跟 ':'
+bool HttpRequest::ParseHeader(const char *base, Span line) {
+    std::string_view str = View(base, line);
+    size_t colon = Scan::FindNonToken(str.data(), str.data() + str.size()) -
+                   str.data();
+    if (colon == 0 || colon == str.size() || str[colon] != ':') {
+        LOG_WARN("Header line error");
+        return false;
+    }
+    if (headers_.size() >= MAX_HEADERS) {
+        LOG_WARN("Too many headers");
         return false;
     }
-    while (buff.ReadableBytes() && state_ != FINISH) {
-        // 每次读取一行
-        const char *line_end =
-            std::search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buff.Peek(), line_end);
-        switch (state_) {
-        case REQUEST_LINE:
-            if (!ParseRequestLine(line)) {
+    size_t begin = colon + 1;
+    size_t end = str.size();
+    while (begin < end && (str[begin] == ' ' || str[begin] == '\t')) {
+        begin++;
+    }
+    while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t')) {
+        end--;
+    }
+    HEADER id = HeaderId(str.substr(0, colon));
+    if (id != HEADER_COUNT) {
+        // 重复的分帧头部无法确定以哪个为准，可能被用于请求走私
+        if (known_[id] &&
+            (id == HDR_CONTENT_LENGTH || id == HDR_TRANSFER_ENCODING)) {
+            LOG_WARN("Duplicate framing header");
+            return false;
+        }
+        known_[id] = static_cast<uint8_t>(headers_.size() + 1);
+    }
+    headers_.push_back(HeaderEntry{
+        static_cast<uint16_t>(line.off), static_cast<uint16_t>(colon),
+        static_cast<uint16_t>(line.off + begin),
+        static_cast<uint16_t>(end - begin)});
+    return true;
+}
+
+HttpRequest::HEADER HttpRequest::HeaderId(std::string_view name) {
+    // 与 HEADER 的顺序一致
+    static const std::string_view NAMES[HEADER_COUNT] = {
+        "Connection",
+        "Content-Length",
+        "Content-Type",
+        "Host",
+        "Range",
+        "If-Range",
+        "If-None-Match",
+        "If-Modified-Since",
+        "Accept-Encoding",
+        "Transfer-Encoding",
+        "Upgrade",
+        "HTTP2-Settings",
+    };
+    for (int i = 0; i < HEADER_COUNT; i++) {
+        if (EqualsNoCase(name, NAMES[i])) {
+            return static_cast<HEADER>(i);
+        }
+    }
+    return HEADER_COUNT;
+}
+
+// 头部结束后确定请求体的分帧方式和连接是否保持
+bool HttpRequest::ParseFraming(const char *base) {
+    // 重复的 Content-Length 和 Transfer-Encoding 在 ParseHeader 中已拒绝
+    bool has_length = known_[HDR_CONTENT_LENGTH] != 0;
+    bool chunked = known_[HDR_TRANSFER_ENCODING] != 0;
+    size_t length = 0;
+    if (has_length &&
+        !ParseNumber(Value(base, headers_[known_[HDR_CONTENT_LENGTH] - 1]),
+                     10, &length)) {
+        return false;
+    }
+    if (chunked) {
+        // 只支持 chunked，且必须是最后一个编码
+        std::string_view value =
+            Value(base, headers_[known_[HDR_TRANSFER_ENCODING] - 1]);
+        size_t comma = value.rfind(',');
+        std::string_view last = value;
+        if (comma != std::string_view::npos) {
+            last = value.substr(comma + 1);
+        }
+        while (!last.empty() && (last[0] == ' ' || last[0] == '\t')) {
+            last.remove_prefix(1);
+        }
+        if (!EqualsNoCase(last, "chunked")) {
+            LOG_WARN("Transfer-Encoding not supported");
+            return false;
+        }
+    }
+    bool keep_alive =
+        known_[HDR_CONNECTION] &&
+        EqualsNoCase(Value(base, headers_[known_[HDR_CONNECTION] - 1]),
+                     "keep-alive");
+    // 同时出现时无法确定边界，可能被用于请求走私
+    if (chunked && has_length) {
+        LOG_WARN("Both Content-Length and chunked");
+        return false;
+    }
+    if (length > MaxBody()) {
+        LOG_WARN("Request body too large");
+        error_code_ = 413;
+        return false;
+    }
+    keep_alive_ = keep_alive && View(base, version_span_) == "1.1";
+    form_ = View(base, method_span_) == "POST" && known_[HDR_CONTENT_TYPE] &&
+            Value(base, headers_[known_[HDR_CONTENT_TYPE] - 1]) ==
+                "application/x-www-form-urlencoded";
+    head_len_ = pos_;
+    if (chunked) {
+        state_ = CHUNK_SIZE;
+    } else if (length > 0) {
+        body_left_ = body_size_ = length;
+        streaming_ = length > MAX_INLINE_BODY;
+        if (streaming_ && !sink_->OnBodyStart(this)) {
+            return false;
+        }
+        if (!streaming_) {
+            inline_body_.reserve(length);
+        }
+        state_ = BODY;
+    } else {
+        state_ = FINISH;
+    }
+    return true;
+}
+
+// 解析并解码已读到的请求体
+// 数据可能跨越多块，逐块交给 OnBodyData；解析过的请求体和分帧字节随后
+// 从缓冲区删除，整块的删除不移动数据，缓冲区中只保留头部
+bool HttpRequest::ParseBody(Buffer &buff) {
+    size_t readable = buff.ReadableBytes();
+    bool ok = true;
+    while (ok && state_ != FINISH) {
+        size_t avail = readable - pos_;
+        if (state_ == BODY || state_ == CHUNK_DATA) {
+            size_t n = std::min(body_left_, avail);
+            if (n == 0) {
+                break;
+            }
+            for (size_t done = 0; ok && done < n;) {
+                size_t len;
+                const char *data = buff.At(pos_ + done, &len);
+                len = std::min(len, n - done);
+                ok = OnBodyData(data, len);
+                done += len;
+            }
+            pos_ += n;
+            body_left_ -= n;
+            if (body_left_ == 0) {
+                state_ = state_ == BODY ? FINISH : CHUNK_DATA_CRLF;
+            }
+        } else if (state_ == CHUNK_DATA_CRLF) {
+            if (avail < 2) {
+                break;
+            }
+            char crlf[2];
+            buff.CopyOut(pos_, crlf, 2);
+            if (crlf[0] != '\r' || crlf[1] != '\n') {
+                LOG_WARN("Chunk data error");
                 return false;
             }
-            ParsePath();
-            break;
-        case HEADERS:
-            ParseHeader(line);
-            if (buff.ReadableBytes() <= 2) {
+            pos_ += 2;
+            state_ = CHUNK_SIZE;
+        } else {
+            // chunk-size [; ext] 或 trailer 行
+            size_t crlf = buff.FindCRLF(pos_);
+            if (crlf == readable) {
+                if (avail > MAX_LINE) {
+                    LOG_WARN("Chunk line too long");
+                    return false;
+                }
+                break;
+            }
+            size_t line_len = crlf - pos_;
+            char prefix[CHUNK_SIZE_PREFIX];
+            std::string_view line(prefix,
+                                  std::min(line_len, sizeof(prefix)));
+            buff.CopyOut(pos_, prefix, line.size());
+            pos_ = crlf + 2;
+            if (state_ == CHUNK_SIZE) {
+                line = line.substr(0, line.find(';'));
+                if (!ParseNumber(line, 16, &body_left_)) {
+                    LOG_WARN("Chunk size error");
+                    return false;
+                }
+                if (body_left_ > MaxBody() - body_size_) {
+                    LOG_WARN("Request body too large");
+                    error_code_ = 413;
+                    return false;
+                }
+                body_size_ += body_left_;
+                state_ = body_left_ > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            } else if (line_len == 0) {
                 state_ = FINISH;
             }
-            break;
-        case BODY:
-            ParseBody(line);
-            break;
-        default:
-            break;
         }
-        if (line_end == buff.BeginWrite()) {
-            break;
+    }
+    if (!ok) {
+        return false;
+    }
+    buff.Erase(head_len_, pos_ - head_len_);
+    pos_ = head_len_;
+    if (state_ == FINISH && streaming_) {
+        sink_->OnBodyEnd();
+    }
+    return true;
+}
+
+bool HttpRequest::OnBodyData(const char *data, size_t len) {
+    if (!streaming_ && inline_body_.size() + len > MAX_INLINE_BODY) {
+        // chunked 请求体超过了内联上限，这时一定有 sink_ (见 MaxBody)，
+        // 已保存的部分先交给它
+        streaming_ = true;
+        if (!sink_->OnBodyStart(this)) {
+            return false;
+        }
+        if (!inline_body_.empty() &&
+            !sink_->OnBody(inline_body_.data(), inline_body_.size())) {
+            return false;
+        }
+        decltype(inline_body_)(&arena_).swap(inline_body_);
+    }
+    if (streaming_) {
+        return sink_->OnBody(data, len);
+    }
+    inline_body_.append(data, len);
+    return true;
+}
+
+bool HttpRequest::ParseNumber(std::string_view str, int base, size_t *num) {
+    // 最多 15 位，避免溢出
+    if (str.empty() || str.size() > 15) {
+        return false;
+    }
+    size_t n = 0;
+    for (char ch : str) {
+        int digit;
+        if (ch >= '0' && ch <= '9') {
+            digit = ch - '0';
+        } else if (base == 16 && ch >= 'a' && ch <= 'f') {
+            digit = ch - 'a' + 10;
+        } else if (base == 16 && ch >= 'A' && ch <= 'F') {
+            digit = ch - 'A' + 10;
+        } else {
+            return false;
         }
-        buff.RetrieveUntil(line_end + 2);
+        n = n * base + digit;
     }
-    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(),
-              version_.c_str());
+    *num = n;
     return true;
 }
 
+// 请求完整，把偏移转换为指向缓冲区的 string_view
+void HttpRequest::Finish(const char *base) {
+    length_ = pos_;
+    method_ = View(base, method_span_);
+    version_ = View(base, version_span_);
+    // 流式接收的请求体已交给 sink_
+    body_ = streaming_ ? std::string_view() : std::string_view(inline_body_);
+    std::string_view path = View(base, path_span_);
+    path_.assign(path.data(), path.size());
+    base_ = base;
+    ParsePath();
+    if (!body_.empty() || streaming_) {
+        ParsePost();
+        LOG_DEBUG("body len: %d", (int)body_.size());
+    }
+}
+
+bool HttpRequest::EqualsNoCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
 void HttpRequest::ParsePath() {
     if (path_ == "/") {
         path_ = "/index.html";
@@ -77,54 +431,25 @@ void HttpRequest::ParsePath() {
     }
 }
 
-bool HttpRequest::ParseRequestLine(const std::string &line) {
-    std::string myline(line);
-    std::regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    std::smatch sub_match;
-    if (regex_match(myline, sub_match, pattern)) {
-        method_ = sub_match[1];
-        path_ = sub_match[2];
-        version_ = sub_match[3];
-        state_ = HEADERS;
-        return true;
-    }
-    LOG_ERROR("Requestline error");
-    return false;
-}
-
-void HttpRequest::ParseHeader(const std::string &line) {
-    std::regex pattern("^([^:]*): ?(.*)$");
-    std::smatch sub_match;
-    if (regex_match(line, sub_match, pattern)) {
-        header_[sub_match[1]] = sub_match[2];
-    } else {
-        state_ = BODY;
-    }
-}
-
-void HttpRequest::ParseBody(const std::string &line) {
-    body_ = line;
-    ParsePost();
-    state_ = FINISH;
-    LOG_DEBUG("body: %s, len: %d", line.c_str(), line.size());
-}
-int HttpRequest::ConverHex(char ch) {
-    if (ch >= 'A' && ch <= 'F')
-        return ch - 'A' + 10;
-    if (ch >= 'a' && ch <= 'f')
-        return ch - 'a' + 10;
-    return ch;
-}
 void HttpRequest::ParsePost() {
-    if (method_ == "POST" &&
-        header_["Content-Type"] == "application/x-www-form-urlencoded") {
-        ParseFromUrlEncoded();
-        if (default_html_tag.count(path_)) {
-            int tag = default_html_tag.find(path_)->second;
+    if (form_) {
+        // 流式接收的表单已由 BodySink 解码
+        if (!streaming_) {
+            ParseFromUrlEncoded();
+        }
+        auto it = default_html_tag.find(path_);
+        if (it != default_html_tag.end()) {
+            int tag = it->second;
             LOG_DEBUG("Tag:%d", tag);
             if (tag == 0 || tag == 1) {
                 bool is_login = (tag == 1);
-                if (UserVerify(post_["username"], post_["password"],
+                // 用 find 而不是 []，缺少的字段不插入表中
+                auto field = [this](const char *key) {
+                    auto it = post_.find(std::pmr::string(key, &arena_));
+                    return it == post_.end() ? std::string_view()
+                                             : std::string_view(it->second);
+                };
+                if (UserVerify(field("username"), field("password"),
                                is_login)) {
                     path_ = "/welcome.html";
                 } else {
@@ -136,54 +461,19 @@ void HttpRequest::ParsePost() {
 }
 
 void HttpRequest::ParseFromUrlEncoded() {
-    if (body_.size() == 0) {
-        return;
-    }
-
-    std::string key, value;
-    int num = 0;
-    int n = body_.size();
-    int i = 0, j = 0;
-
-    for (; i < n; i++) {
-        char ch = body_[i];
-        switch (ch) {
-        case '=':
-            key = body_.substr(j, i - j);
-            j = i + 1;
-            break;
-        case '+':
-            body_[i] = ' ';
-            break;
-        case '%':
-            num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-            body_[i + 2] = num % 10 + '0';
-            body_[i + 1] = num / 10 + '0';
-            i += 2;
-            break;
-        case '&':
-            value = body_.substr(j, i - j);
-            j = i + 1;
-            post_[key] = value;
-            LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
-            break;
-        default:
-            break;
-        }
-    }
-    assert(j <= i);
-    if (post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
-    }
+    FormDecoder decoder(&post_);
+    // 内联的请求体不超过 MAX_INLINE_BODY，不会超出字段的长度上限
+    decoder.Feed(body_.data(), body_.size());
+    decoder.End();
 }
 
-bool HttpRequest::UserVerify(const std::string &name, const std::string &pwd,
+bool HttpRequest::UserVerify(std::string_view name, std::string_view pwd,
                              bool is_login) {
-    if (name == "" || pwd == "") {
+    if (name.empty() || pwd.empty()) {
         return false;
     }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
+    LOG_INFO("Verify name:%.*s pwd:%.*s", (int)name.size(), name.data(),
+             (int)pwd.size(), pwd.data());
     MYSQL *sql;
     SqlConnRAII(&sql, SqlConnPool::Instance());
     assert(sql);
@@ -199,8 +489,9 @@ bool HttpRequest::UserVerify(const std::string &name, const std::string &pwd,
     }
     /* 查询用户及密码 */
     snprintf(order, 256,
-             "SELECT username, password FROM user WHERE username='%s' LIMIT 1",
-             name.c_str());
+             "SELECT username, password FROM user WHERE username='%.*s' "
+             "LIMIT 1",
+             (int)name.size(), name.data());
     LOG_DEBUG("%s", order);
 
     if (mysql_query(sql, order)) {
@@ -234,8 +525,8 @@ bool HttpRequest::UserVerify(const std::string &name, const std::string &pwd,
         LOG_DEBUG("regirster!");
         bzero(order, 256);
         snprintf(order, 256,
-                 "INSERT INTO user(username, password) VALUES('%s','%s')",
-                 name.c_str(), pwd.c_str());
+                 "INSERT INTO user(username, password) VALUES('%.*s','%.*s')",
+                 (int)name.size(), name.data(), (int)pwd.size(), pwd.data());
         LOG_DEBUG("%s", order);
         if (mysql_query(sql, order)) {
             LOG_DEBUG("Insert error!");
@@ -248,25 +539,43 @@ bool HttpRequest::UserVerify(const std::string &name, const std::string &pwd,
     return flag;
 }
 
-std::string HttpRequest::Path() const { return path_; }
+std::string_view HttpRequest::Path() const { return path_; }
 
-std::string &HttpRequest::Path() { return path_; }
-std::string HttpRequest::Method() const { return method_; }
+std::string_view HttpRequest::Method() const { return method_; }
 
-std::string HttpRequest::Version() const { return version_; }
+std::string_view HttpRequest::Version() const { return version_; }
+
+std::string_view HttpRequest::GetHeader(std::string_view key) const {
+    HEADER id = HeaderId(key);
+    if (id != HEADER_COUNT) {
+        return GetHeader(id);
+    }
+    if (!base_) {
+        return std::string_view();
+    }
+    // 从后往前，与常用头部一样取最后一个
+    for (size_t i = headers_.size(); i > 0; i--) {
+        if (EqualsNoCase(Name(base_, headers_[i - 1]), key)) {
+            return Value(base_, headers_[i - 1]);
+        }
+    }
+    return std::string_view();
+}
 
 std::string HttpRequest::GetPost(const std::string &key) const {
     assert(key != "");
-    if (post_.count(key) == 1) {
-        return post_.find(key)->second;
+    auto it = post_.find(std::pmr::string(key));
+    if (it != post_.end()) {
+        return std::string(it->second);
     }
     return "";
 }
 
 std::string HttpRequest::GetPost(const char *key) const {
     assert(key != nullptr);
-    if (post_.count(key) == 1) {
-        return post_.find(key)->second;
+    auto it = post_.find(std::pmr::string(key));
+    if (it != post_.end()) {
+        return std::string(it->second);
     }
     return "";
 }
\ No newline at end of file
@@ -1,25 +1,69 @@
 #ifndef __HTPPREQUEST_H__
 #define __HTPPREQUEST_H__
 
-#include "../buffer/buffer.h"
+#include "../buffer/arena.h"
+#include "../buffer/buffer.hpp"
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
+#include <algorithm>
 #include <errno.h>
+#include <memory_resource>
 #include <mysql/mysql.h>
-#include <regex>
+#include <stdint.h>
 #include <string>
+#include <string_view>
+#include <strings.h>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
+class HttpRequest;
+
+// 流式接收请求体，超过内联上限的请求体以解码后的分段交付
+// 交付是同步的：OnBody 返回之前连接不会继续读取，处理慢时数据积压在
+// socket 缓冲区中，由 TCP 流量控制反压到客户端
+class BodySink {
+  public:
+    virtual ~BodySink() = default;
+    // 开始流式交付，这时请求的头部已解析，可以用 IsForm 等判断请求体
+    // 的类型，但还不能用 GetHeader
+    virtual bool OnBodyStart(HttpRequest *request) = 0;
+    // 返回 false 表示放弃该请求
+    virtual bool OnBody(const char *data, size_t len) = 0;
+    virtual void OnBodyEnd() = 0;
+};
 
 // 主要实现了对请求内容的解析
+// 解析器是可恢复的状态机：数据不完整时记录已扫描到的位置，读到更多数据后
+// 从断点继续，不会重新扫描；请求完整之前不消费缓冲区，各字段以相对
+// buff.Peek() 的偏移保存
+// 读缓冲区是块链，请求行和头部在第一块中扫描，行跨越块的边界时才用
+// Pullup 把头部移到一块中，整个头部在一块中读到时不做拷贝
+// 请求完整后方法、版本和头部都是指向读缓冲区的 string_view，
+// 在调用方消费 (Retrieve) 这个请求之前有效
+// 路径、头部表和表单等解析产生的对象都分配在请求自己的 arena_ 中，
+// 开始解析下一个请求时整体回收，解析过程不经过 malloc
+// 请求体按 Content-Length 或 chunked 分帧，逐块解码后从缓冲区删除，
+// 缓冲区中只保留头部；不超过 MAX_INLINE_BODY 的请求体保存在 arena_ 中，
+// 更大的边读边交给 BodySink；没有 BodySink 时更大的请求体以 413 拒绝
+// urlencoded 表单解码到 post_，大的表单由 BodySink 边读边解码
 class HttpRequest {
   public:
     enum PARSE_STATE {
         REQUEST_LINE,
         HEADERS,
-        BODY,
+        BODY,            // Content-Length 请求体
+        CHUNK_SIZE,      // chunk 大小行
+        CHUNK_DATA,      // chunk 数据
+        CHUNK_DATA_CRLF, // chunk 数据后的 CRLF
+        CHUNK_TRAILER,   // 最后一个 chunk 之后的 trailer
         FINISH,
     };
+    enum PARSE_RESULT {
+        PARSE_INCOMPLETE, // 数据不完整，等待更多数据后再次调用
+        PARSE_COMPLETE,   // 得到一个完整请求
+        PARSE_ERROR,      // 请求格式错误或超出长度限制
+    };
     enum HTTP_CODE {
         NO_REQUEST,
         GET_REQUEST,
@@ -30,35 +74,147 @@ class HttpRequest {
         INTERNAL_ERROR,
         CLOSED_CONNECTION,
     };
-    HttpRequest() { Init(); }
+    // 长度限制
+    static const size_t MAX_LINE = 8192;         // 请求行
+    static const size_t MAX_HEADER_SIZE = 16384; // 请求行和所有头部
+    static const size_t MAX_HEADERS = 64;
+    static const size_t MAX_INLINE_BODY = 64 * 1024;
+    static const size_t MAX_BODY = 64 * 1024 * 1024;
+    // 解析时识别的常用头部，按名字不区分大小写匹配，查找只是数组下标
+    enum HEADER {
+        HDR_CONNECTION,
+        HDR_CONTENT_LENGTH,
+        HDR_CONTENT_TYPE,
+        HDR_HOST,
+        HDR_RANGE,
+        HDR_IF_RANGE,
+        HDR_IF_NONE_MATCH,
+        HDR_IF_MODIFIED_SINCE,
+        HDR_ACCEPT_ENCODING,
+        HDR_TRANSFER_ENCODING,
+        HDR_UPGRADE,
+        HDR_HTTP2_SETTINGS,
+        HEADER_COUNT,
+    };
+
+    // 表单字段，存储在 arena_ 中
+    typedef std::pmr::unordered_map<std::pmr::string, std::pmr::string>
+        PostMap;
+
+    HttpRequest()
+        : sink_(nullptr), headers_(&arena_), path_(&arena_),
+          inline_body_(&arena_), post_(&arena_) {
+        Init();
+    }
     ~HttpRequest() = default;
 
+    // 开始新的请求，上一个请求的对象随 arena_ 一起回收
     void Init();
-    bool Pares(Buffer &buff);
-    std::string Path() const;
-    std::string &Path();
-    std::string Method() const;
-    std::string Version() const;
+    // 连接空闲或关闭时把 arena_ 的块都归还 BlockPool
+    void Release();
+    size_t HeldBytes() const { return arena_.Capacity(); }
+    // 上一个请求完成后再次调用时自动开始解析下一个请求
+    PARSE_RESULT Pares(Buffer &buff);
+    // 完整请求在缓冲区中占用的字节数，处理完后由调用方 Retrieve；
+    // 请求体在解析时已从缓冲区删除，不计在内
+    size_t Length() const { return length_; }
+    std::string_view Path() const;
+    std::string_view Method() const;
+    std::string_view Version() const;
+    // 请求完整后有效，不存在时返回空；同名头部出现多次时取最后一个
+    std::string_view GetHeader(HEADER id) const {
+        return known_[id] && base_ ? Value(base_, headers_[known_[id] - 1])
+                                   : std::string_view();
+    }
+    // 名字不区分大小写，常用头部直接查表，其他的顺序查找
+    std::string_view GetHeader(std::string_view key) const;
     std::string GetPost(const std::string &key) const;
     std::string GetPost(const char *key) const;
     bool IsKeepAlive() const;
+    // 请求体是否以流式交付，这时 body 为空
+    bool IsStreaming() const { return streaming_; }
+    // 是否是 application/x-www-form-urlencoded 的 POST，头部解析完后有效
+    bool IsForm() const { return form_; }
+    // 流式接收的表单由 BodySink 解码到这里，之后和内联的表单一样处理
+    PostMap *MutablePost() { return &post_; }
+    // 接收大请求体的 sink，在连接上一直有效；为空时大请求体被拒绝
+    void SetBodySink(BodySink *sink) { sink_ = sink; }
+    // 解析失败时应答的状态码，请求体超过上限为 413，其余为 400
+    int ErrorCode() const { return error_code_; }
 
   private:
-    bool ParseRequestLine(const std::string &line);
-    void ParseHeader(const std::string &line);
-    void ParseBody(const std::string &line);
+    // 头部表预留的项数
+    static const size_t COMMON_HEADERS = 16;
+    // chunk 大小行只需要开头的这些字节，更长的大小一定不合法
+    static const size_t CHUNK_SIZE_PREFIX = 32;
+    // 相对 buff.Peek() 的偏移
+    struct Span {
+        uint32_t off;
+        uint32_t len;
+    };
+    // 头部表的一项，同样是相对 buff.Peek() 的偏移；头部都在前
+    // MAX_HEADER_SIZE 字节内，16 位就够，一项 8 字节
+    struct HeaderEntry {
+        uint16_t name_off;
+        uint16_t name_len;
+        uint16_t value_off;
+        uint16_t value_len;
+    };
+    static_assert(MAX_HEADER_SIZE <= UINT16_MAX, "header offset overflow");
+    PARSE_RESULT ParseLines(Buffer &buff);
+    bool ParseRequestLine(const char *base, Span line);
+    bool ParseHeader(const char *base, Span line);
+    bool ParseFraming(const char *base);
+    bool ParseBody(Buffer &buff);
+    // 一段解码后的请求体，内联保存或交给 sink_
+    bool OnBodyData(const char *data, size_t len);
+    static bool ParseNumber(std::string_view str, int base, size_t *num);
+    // 没有 sink_ 时请求体只能内联保存
+    size_t MaxBody() const { return sink_ ? MAX_BODY : MAX_INLINE_BODY; }
+    void Finish(const char *base);
     void ParsePath();
     void ParsePost();
     void ParseFromUrlEncoded();
-    static bool UserVerify(const std::string &name, const std::string &pwd,
+    static std::string_view View(const char *base, Span span) {
+        return std::string_view(base + span.off, span.len);
+    }
+    static std::string_view Name(const char *base, HeaderEntry entry) {
+        return std::string_view(base + entry.name_off, entry.name_len);
+    }
+    static std::string_view Value(const char *base, HeaderEntry entry) {
+        return std::string_view(base + entry.value_off, entry.value_len);
+    }
+    // 常用头部的编号，不是常用头部时返回 HEADER_COUNT
+    static HEADER HeaderId(std::string_view name);
+    static bool EqualsNoCase(std::string_view a, std::string_view b);
+    static bool UserVerify(std::string_view name, std::string_view pwd,
                            bool is_login);
     PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
-    std::unordered_map<std::string, std::string> post_;
-    static const std::unordered_set<std::string> default_html;
-    static const std::unordered_map<std::string, int> default_html_tag;
-    static int ConverHex(char ch);
+    size_t pos_;        // 已扫描到的位置
+    size_t line_start_; // 当前行的起始位置
+    size_t length_;
+    size_t head_len_;   // 请求行和头部的长度，请求体从这里开始
+    size_t body_left_;  // 当前 Content-Length 或 chunk 还未读到的字节数
+    size_t body_size_;  // 请求体总长度
+    bool keep_alive_;
+    bool streaming_;
+    bool form_;
+    int error_code_;
+    BodySink *sink_;
+    Span method_span_, path_span_, version_span_;
+    std::string_view method_, version_, body_;
+    const char *base_; // 请求完整时的 buff.Peek()
+    // 常用头部在 headers_ 中的下标加 1，0 表示没有出现
+    uint8_t known_[HEADER_COUNT];
+    static_assert(MAX_HEADERS <= UINT8_MAX, "header index overflow");
+    // 以下容器的存储都在 arena_ 中，需在它之后构造、之前析构
+    Arena arena_;
+    std::pmr::vector<HeaderEntry> headers_;
+    std::pmr::string path_;
+    std::pmr::string inline_body_; // 不超过 MAX_INLINE_BODY 的请求体
+    PostMap post_;
+    static const std::unordered_set<std::string_view> default_html;
+    static const std::unordered_map<std::string_view, int> default_html_tag;
 };
 
 #endif //__HTPPREQUEST_H__
\ No newline at end of file
@@ -2,7 +2,22 @@
 
 using namespace std;
 
-const unordered_map<string, string> HttpResponse::suffix_type = {
+namespace {
+struct MimeType {
+    string_view suffix;
+    string_view type;
+};
+
+// 状态行和两种 Connection 头部拼接好的结果，后面直接接 Date 的值
+struct StatusLine {
+    int code;
+    string_view reason;
+    string_view keep_alive;
+    string_view close;
+};
+} // namespace
+
+static constexpr MimeType MIME_TYPES[] = {
     {".html", "text/html"},
     {".xml", "text/xml"},
     {".xhtml", "application/xhtml+xml"},
@@ -20,155 +35,456 @@ const unordered_map<string, string> HttpResponse::suffix_type = {
     {".avi", "video/x-msvideo"},
     {".gz", "application/x-gzip"},
     {".tar", "application/x-tar"},
-    {".css", "text/css "},
-    {".js", "text/javascript "},
+    {".css", "text/css"},
+    {".js", "text/javascript"},
 };
 
-const unordered_map<int, string> HttpResponse::code_status = {
-    {200, "OK"},
-    {400, "Bad Request"},
-    {403, "Forbidden"},
-    {404, "Not Found"},
-};
+#define KEEP_ALIVE_HEADER                                                      \
+    "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\nDate: "
+#define CLOSE_HEADER "Connection: close\r\nDate: "
+#define STATUS_LINE(code, reason)                                              \
+    {                                                                          \
+        code, reason, "HTTP/1.1 " #code " " reason "\r\n" KEEP_ALIVE_HEADER,   \
+            "HTTP/1.1 " #code " " reason "\r\n" CLOSE_HEADER                   \
+    }
 
-const unordered_map<int, string> HttpResponse::code_path = {
-    {400, "/400.html"},
-    {403, "/403.html"},
-    {404, "/404.html"},
+static constexpr StatusLine STATUS_LINES[] = {
+    STATUS_LINE(200, "OK"),
+    STATUS_LINE(206, "Partial Content"),
+    STATUS_LINE(304, "Not Modified"),
+    STATUS_LINE(400, "Bad Request"),
+    STATUS_LINE(403, "Forbidden"),
+    STATUS_LINE(404, "Not Found"),
+    STATUS_LINE(413, "Content Too Large"),
+    STATUS_LINE(416, "Range Not Satisfiable"),
 };
+static constexpr int STATUS_COUNT =
+    sizeof(STATUS_LINES) / sizeof(*STATUS_LINES);
+
+string HttpResponse::error_page_[STATUS_COUNT];
+
+// multipart/byteranges 的分隔符和固定的片段
+#define BOUNDARY "00000000000myserver_byteranges"
+static constexpr string_view MULTIPART_TYPE =
+    "Content-type: multipart/byteranges; boundary=" BOUNDARY "\r\n";
+static constexpr string_view PART_BEGIN = "\r\n--" BOUNDARY "\r\n";
+static constexpr string_view MULTIPART_END = "\r\n--" BOUNDARY "--\r\n";
+static const char PART_RANGE[] = "Content-Range: bytes %zu-%zu/%zu\r\n\r\n";
 
 HttpResponse::HttpResponse() {
     code_ = -1;
-    path_ = src_dir_ = "";
     is_keep_alive_ = false;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    omit_body_ = false;
+    accept_encoding_ = 0;
+    seg_cnt_ = 0;
+    tail_len_ = 0;
+    buff_mark_ = 0;
 };
 
-HttpResponse::~HttpResponse() { UnmapFile(); }
+HttpResponse::~HttpResponse() {}
 
-void HttpResponse::Init(const string &src_dir, string &path, bool is_keep_alive,
-                        int code) {
-    assert(src_dir != "");
-    if (mm_file_) {
-        UnmapFile();
-    }
+void HttpResponse::Init(string_view src_dir, string_view path,
+                        bool is_keep_alive, int code, int accept_encoding) {
+    assert(!src_dir.empty());
+    file_.reset();
     code_ = code;
     is_keep_alive_ = is_keep_alive;
-    path_ = path;
-    src_dir_ = src_dir;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    omit_body_ = false;
+    accept_encoding_ = accept_encoding;
+    if_none_match_ = if_modified_since_ = string_view();
+    range_ = if_range_ = string_view();
+    seg_cnt_ = 0;
+    tail_len_ = 0;
+    path_.assign(src_dir.data(), src_dir.size());
+    path_ += path;
 }
 
 void HttpResponse::MakeResponse(Buffer &buff) {
-    /* 判断请求的资源文件 */
-    if (stat((src_dir_ + path_).data(), &mm_file_stat_) < 0 ||
-        S_ISDIR(mm_file_stat_.st_mode)) {
-        code_ = 404;
-    } else if (!(mm_file_stat_.st_mode & S_IROTH)) {
-        code_ = 403;
-    } else if (code_ == -1) {
-        code_ = 200;
-    }
-    ErrorHtml();
+    buff_mark_ = buff.ReadableBytes();
+    seg_cnt_ = 0;
+    /* 判断请求的资源文件，请求本身出错时直接使用错误页 */
+    if (code_ < 400) {
+        int code = 200;
+        file_ = FileCache::Instance()->Get(path_, accept_encoding_, &code);
+        if (!file_) {
+            code_ = code;
+        } else if (code_ == -1) {
+            code_ = 200;
+        }
+        if (file_ && code_ == 200) {
+            if (NotModified()) {
+                code_ = 304;
+            } else if (!range_.empty() && IfRangeMatch()) {
+                int n = ParseRange(range_, file_->size);
+                if (n == 0) {
+                    code_ = 416;
+                } else if (n > 0) {
+                    code_ = 206;
+                    seg_cnt_ = n;
+                }
+            }
+        }
+    }
     AddStateLine(buff);
-    AddHeader(buff);
     AddContent(buff);
+    if (omit_body_) {
+        file_.reset();
+    }
+    tail_len_ = buff.ReadableBytes() - buff_mark_;
 }
 
-char *HttpResponse::File() { return mm_file_; }
-
-size_t HttpResponse::FileLen() const { return mm_file_stat_.st_size; }
+// 第 i 个片段之前的文本已经追加完
+void HttpResponse::EndSegment(Buffer &buff, int i) {
+    segs_[i].head_len = buff.ReadableBytes() - buff_mark_;
+    buff_mark_ = buff.ReadableBytes();
+}
 
-void HttpResponse::ErrorHtml() {
-    if (code_path.count(code_) == 1) {
-        path_ = code_path.find(code_)->second;
-        stat((src_dir_ + path_).data(), &mm_file_stat_);
+int HttpResponse::StatusIndex(int code) {
+    for (int i = 0; i < STATUS_COUNT; i++) {
+        if (STATUS_LINES[i].code == code) {
+            return i;
+        }
     }
+    return -1;
 }
 
-// 将状态写入缓冲区，等待写入 fd 中
+// 将状态行、Connection 和 Date 写入缓冲区，等待写入 fd 中
 void HttpResponse::AddStateLine(Buffer &buff) {
-    string status;
-    if (code_status.count(code_) == 1) {
-        status = code_status.find(code_)->second;
-    } else {
+    int index = StatusIndex(code_);
+    if (index < 0) {
         code_ = 400;
-        status = code_status.find(400)->second;
+        index = StatusIndex(400);
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    const StatusLine &status = STATUS_LINES[index];
+    buff.Append(is_keep_alive_ ? status.keep_alive : status.close);
+    const char *date = CoarseClock::Wall().http_date;
+    buff.Append(date, strlen(date));
+    buff.Append("\r\n", 2);
 }
 
-// 将 html 的头写入 缓冲区
-void HttpResponse::AddHeader(Buffer &buff) {
-    buff.Append("Connection: ");
-    if (is_keep_alive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
-    } else {
-        buff.Append("close\r\n");
+// 将文件相关信息写入缓冲区，文件的头部已由 FileCache 生成
+void HttpResponse::AddContent(Buffer &buff) {
+    if (code_ == 304) {
+        // 没有响应体，只带上校验头部
+        buff.Append(file_->validators);
+        buff.Append("\r\n", 2);
+        file_.reset();
+        return;
+    }
+    if (!file_) {
+        string_view page = error_page_[StatusIndex(code_)];
+        if (omit_body_) {
+            page = page.substr(0, page.find("\r\n\r\n") + 4);
+        }
+        buff.Append(page);
+        return;
+    }
+    char line[96];
+    if (code_ == 416) {
+        int len = snprintf(line, sizeof(line),
+                           "Content-Range: bytes */%zu\r\n"
+                           "Content-length: 0\r\n\r\n",
+                           file_->size);
+        buff.Append(line, len);
+        file_.reset();
+        return;
+    }
+    if (code_ == 206) {
+        AddRanges(buff);
+        return;
+    }
+    buff.Append(file_->headers);
+    buff.Append("\r\n", 2);
+    if (file_->size > 0 && !omit_body_) {
+        segs_[0].begin = 0;
+        segs_[0].end = file_->size;
+        seg_cnt_ = 1;
+        EndSegment(buff, 0);
     }
-    buff.Append("Content-type: " + GetFileType() + "\r\n");
 }
 
-// 将文件相关信息写入缓冲区
-void HttpResponse::AddContent(Buffer &buff) {
-    int ser_fd = open((src_dir_ + path_).data(), O_RDONLY);
-    if (ser_fd < 0) {
-        ErrorContent(buff, "File NotFound!");
+// 单个范围直接返回该范围，多个范围使用 multipart/byteranges
+void HttpResponse::AddRanges(Buffer &buff) {
+    char line[96];
+    int len;
+    if (seg_cnt_ == 1) {
+        Segment &seg = segs_[0];
+        buff.Append(file_->content_type);
+        buff.Append(file_->validators);
+        len = snprintf(line, sizeof(line),
+                       "Content-Range: bytes %zu-%zu/%zu\r\n"
+                       "Content-length: %zu\r\n\r\n",
+                       seg.begin, seg.end - 1, file_->size,
+                       seg.end - seg.begin);
+        buff.Append(line, len);
+        if (omit_body_) {
+            seg_cnt_ = 0;
+            return;
+        }
+        EndSegment(buff, 0);
         return;
     }
-
-    /* 将文件映射到内存提高文件的访问速度
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-    LOG_DEBUG("file path %s", (src_dir_ + path_).data());
-    int *mmRet = (int *)mmap(0, mm_file_stat_.st_size, PROT_READ, MAP_PRIVATE,
-                             ser_fd, 0);
-    if (*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
+    // 先算出各分段头的长度，得到总长度后再写 Content-length
+    size_t total = MULTIPART_END.size();
+    for (int i = 0; i < seg_cnt_; i++) {
+        total += PART_BEGIN.size() + file_->content_type.size() +
+                 snprintf(nullptr, 0, PART_RANGE, segs_[i].begin,
+                          segs_[i].end - 1, file_->size) +
+                 segs_[i].end - segs_[i].begin;
+    }
+    buff.Append(MULTIPART_TYPE);
+    buff.Append(file_->validators);
+    len = snprintf(line, sizeof(line), "Content-length: %zu\r\n\r\n", total);
+    buff.Append(line, len);
+    if (omit_body_) {
+        seg_cnt_ = 0;
         return;
     }
-    mm_file_ = (char *)mmRet;
-    close(ser_fd);
-    buff.Append("Content-length: " + to_string(mm_file_stat_.st_size) +
-                "\r\n\r\n");
+    for (int i = 0; i < seg_cnt_; i++) {
+        buff.Append(PART_BEGIN);
+        buff.Append(file_->content_type);
+        len = snprintf(line, sizeof(line), PART_RANGE, segs_[i].begin,
+                       segs_[i].end - 1, file_->size);
+        buff.Append(line, len);
+        EndSegment(buff, i);
+    }
+    buff.Append(MULTIPART_END);
 }
 
-void HttpResponse::UnmapFile() {
-    if (mm_file_) {
-        munmap(mm_file_, mm_file_stat_.st_size);
-        mm_file_ = nullptr;
+string_view HttpResponse::FileType(string_view path) {
+    /* 判断文件类型 */
+    string_view::size_type idx = path.find_last_of('.');
+    if (idx != string_view::npos) {
+        string_view suffix = path.substr(idx);
+        for (const MimeType &mime : MIME_TYPES) {
+            if (mime.suffix == suffix) {
+                return mime.type;
+            }
+        }
     }
+    return "text/plain";
 }
 
-string HttpResponse::GetFileType() {
-    /* 判断文件类型 */
-    string::size_type idx = path_.find_last_of('.');
-    if (idx == string::npos) {
-        return "text/plain";
+// 错误响应中状态行之后的部分：头部和正文
+string HttpResponse::ErrorContent(int index, const string &html) {
+    string body = html;
+    if (body.empty()) {
+        const StatusLine &status = STATUS_LINES[index];
+        body += "<html><title>Error</title>";
+        body += "<body bgcolor=\"ffffff\">";
+        body += to_string(status.code) + " : ";
+        body += status.reason;
+        body += "\n<p>File NotFound!</p>";
+        body += "<hr><em>TinyWebServer</em></body></html>";
     }
-    string suffix = path_.substr(idx);
-    if (suffix_type.count(suffix) == 1) {
-        return suffix_type.find(suffix)->second;
+    return "Content-type: text/html\r\nContent-length: " +
+           to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+void HttpResponse::LoadErrorPages(const string &src_dir) {
+    for (int i = 0; i < STATUS_COUNT; i++) {
+        if (STATUS_LINES[i].code < 400) {
+            continue;
+        }
+        string path = src_dir + "/" + to_string(STATUS_LINES[i].code) + ".html";
+        string html;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            char buf[4096];
+            ssize_t len;
+            while ((len = read(fd, buf, sizeof(buf))) > 0) {
+                html.append(buf, len);
+            }
+            close(fd);
+        }
+        error_page_[i] = ErrorContent(i, html);
     }
-    return "text/plain";
 }
 
-void HttpResponse::ErrorContent(Buffer &buff, string message) {
-    string body;
-    string status;
-    body += "<html><title>Error</title>";
-    body += "<body bgcolor=\"ffffff\">";
-    if (code_status.count(code_) == 1) {
-        status = code_status.find(code_)->second;
-    } else {
-        status = "Bad Request";
+static string_view Trim(string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+static bool EqualsNoCase(string_view a, const char *b) {
+    return a.size() == strlen(b) && strncasecmp(a.data(), b, a.size()) == 0;
+}
+
+// 例如 "gzip, deflate, br;q=0.9"，q 为 0 的编码不可接受
+int HttpResponse::AcceptEncoding(string_view value) {
+    int accept = 0;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        string_view item = value.substr(0, comma);
+        value = comma == string_view::npos ? string_view()
+                                           : value.substr(comma + 1);
+        size_t semi = item.find(';');
+        string_view coding = Trim(item.substr(0, semi));
+        if (semi != string_view::npos) {
+            string_view param = Trim(item.substr(semi + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') &&
+                param[1] == '=') {
+                string_view q = Trim(param.substr(2));
+                if (q.find_first_not_of("0.") == string_view::npos) {
+                    continue;
+                }
+            }
+        }
+        if (EqualsNoCase(coding, "gzip") || EqualsNoCase(coding, "x-gzip")) {
+            accept |= FileCache::ACCEPT_GZIP;
+        } else if (EqualsNoCase(coding, "br")) {
+            accept |= FileCache::ACCEPT_BR;
+        } else if (coding == "*") {
+            accept |= FileCache::ACCEPT_GZIP | FileCache::ACCEPT_BR;
+        }
+    }
+    return accept;
+}
+
+// If-None-Match 优先于 If-Modified-Since
+bool HttpResponse::NotModified() const {
+    if (!if_none_match_.empty()) {
+        return MatchETag(if_none_match_, file_->etag);
+    }
+    time_t since;
+    if (!if_modified_since_.empty() &&
+        ParseHttpDate(if_modified_since_, &since)) {
+        return file_->mtime.tv_sec <= since;
+    }
+    return false;
+}
+
+// 弱比较：忽略 W/ 前缀，list 为 "*" 或逗号分隔的 ETag 列表
+bool HttpResponse::MatchETag(string_view list, string_view etag) {
+    if (etag.compare(0, 2, "W/") == 0) {
+        etag.remove_prefix(2);
+    }
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        string_view item = Trim(list.substr(0, comma));
+        list = comma == string_view::npos ? string_view()
+                                          : list.substr(comma + 1);
+        if (item == "*") {
+            return true;
+        }
+        if (item.compare(0, 2, "W/") == 0) {
+            item.remove_prefix(2);
+        }
+        if (item == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 只接受 RFC 7231 推荐的 IMF-fixdate 格式，例如
+// "Sun, 06 Nov 1994 08:49:37 GMT"
+bool HttpResponse::ParseHttpDate(string_view str, time_t *t) {
+    char buf[64];
+    if (str.size() >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, str.data(), str.size());
+    buf[str.size()] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') {
+        return false;
     }
-    body += to_string(code_) + " : " + status + "\n";
-    body += "<p>" + message + "</p>";
-    body += "<hr><em>TinyWebServer</em></body></html>";
+    *t = timegm(&tm);
+    return true;
+}
 
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+// If-Range 为 ETag 时做强比较，为日期时要求与 Last-Modified 完全相同
+bool HttpResponse::IfRangeMatch() const {
+    if (if_range_.empty()) {
+        return true;
+    }
+    if (if_range_[0] == '"' || if_range_.compare(0, 2, "W/") == 0) {
+        return if_range_[0] == '"' && file_->etag[0] == '"' &&
+               if_range_ == file_->etag;
+    }
+    time_t t;
+    return ParseHttpDate(if_range_, &t) && t == file_->mtime.tv_sec;
+}
+
+static bool ParseOffset(string_view str, size_t *num) {
+    if (str.empty() || str.size() > 18) {
+        return false;
+    }
+    size_t n = 0;
+    for (char ch : str) {
+        if (ch < '0' || ch > '9') {
+            return false;
+        }
+        n = n * 10 + (ch - '0');
+    }
+    *num = n;
+    return true;
+}
+
+// 解析 "bytes=0-99,200-,-50" 到 segs_，返回可满足的范围数
+// 格式错误或范围太多时返回 -1，这时忽略 Range；全部不可满足时返回 0
+int HttpResponse::ParseRange(string_view spec, size_t size) {
+    if (spec.size() < 6 || strncasecmp(spec.data(), "bytes=", 6) != 0) {
+        return -1;
+    }
+    spec.remove_prefix(6);
+    int n = 0;
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        string_view item = Trim(spec.substr(0, comma));
+        spec = comma == string_view::npos ? string_view()
+                                          : spec.substr(comma + 1);
+        if (item.empty()) {
+            continue;
+        }
+        size_t dash = item.find('-');
+        if (dash == string_view::npos) {
+            return -1;
+        }
+        string_view first = Trim(item.substr(0, dash));
+        string_view last = Trim(item.substr(dash + 1));
+        size_t begin, end;
+        if (first.empty()) {
+            // 后缀范围：最后 N 个字节
+            size_t suffix;
+            if (!ParseOffset(last, &suffix)) {
+                return -1;
+            }
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            begin = suffix < size ? size - suffix : 0;
+            end = size;
+        } else {
+            if (!ParseOffset(first, &begin)) {
+                return -1;
+            }
+            end = size;
+            if (!last.empty()) {
+                size_t last_pos;
+                if (!ParseOffset(last, &last_pos) || last_pos < begin) {
+                    return -1;
+                }
+                end = std::min(last_pos + 1, size);
+            }
+            if (begin >= size) {
+                continue;
+            }
+        }
+        if (n == MAX_RANGES) {
+            return -1;
+        }
+        segs_[n].begin = begin;
+        segs_[n].end = end;
+        n++;
+    }
+    return n;
 }
@@ -1,44 +1,109 @@
 #ifndef __HTTPRESPONSE_H__
 #define __HTTPRESPONSE_H__
 
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <unordered_map>
+#include <string_view>
+#include <strings.h>
 
-#include "../buffer/buffer.h"
+#include "../buffer/buffer.hpp"
 #include "../log/log.h"
+#include "../timer/coarseclock.h"
+#include "filecache.h"
 
-// 将响应 文件 写入到缓冲区中，等待写入到 fd 中
+// 将响应头写入到缓冲区中，文件内容取自 FileCache，等待写入到 fd 中
+// 状态行、Connection 头部和 MIME 类型是编译期常量，错误页在启动时加载，
+// 生成响应只是把这些内容拷贝到缓冲区中，不分配内存
+// 响应体由缓冲区中的文本和文件片段交替组成：每个片段之前有 head_len 字节
+// 的文本 (头部、multipart 的分段头)，最后一个片段之后还有 TailLen 字节
 class HttpResponse {
   public:
+    // 响应体中来自文件的片段 [begin, end)
+    struct Segment {
+        size_t head_len; // 上一个片段之后、本片段之前追加到缓冲区的字节数
+        size_t begin;
+        size_t end;
+    };
+    // 超过这个数量的 Range 被忽略，返回完整内容
+    static const int MAX_RANGES = 16;
+    // Shrink 保留的路径容量
+    static const size_t KEEP_PATH = 256;
+
     HttpResponse();
     ~HttpResponse();
-    void Init(const std::string &srcDir, std::string &path,
-              bool is_keep_alive = false, int code = -1);
+    // accept_encoding 为 FileCache::ACCEPT_* 的组合
+    void Init(std::string_view src_dir, std::string_view path,
+              bool is_keep_alive = false, int code = -1,
+              int accept_encoding = 0);
     void MakeResponse(Buffer &buff);
-    void UnmapFile();
-    char *File();
-    size_t FileLen() const;
-    void ErrorContent(Buffer &buff, std::string message);
+    void ClearFile() { file_.reset(); }
+    // 连接关闭时释放文件路径占用的空间和文件的引用
+    void Release() {
+        std::string().swap(path_);
+        file_.reset();
+    }
+    // 连接空闲时只释放超过 KEEP_PATH 的路径，常见的路径保留下来
+    void Shrink() {
+        if (path_.capacity() > KEEP_PATH) {
+            std::string().swap(path_);
+        }
+        file_.reset();
+    }
+    // 交出文件内容的引用，响应写完之前由调用者持有
+    FileCache::EntryPtr ReleaseFile() { return std::move(file_); }
+    int SegmentCount() const { return seg_cnt_; }
+    const Segment &GetSegment(int i) const { return segs_[i]; }
+    size_t TailLen() const { return tail_len_; }
     int Code() const { return code_; }
+    // 条件请求的 If-None-Match 和 If-Modified-Since，在 Init 之后设置
+    // 两者都指向请求所在的读缓冲区，只在 MakeResponse 期间使用
+    void SetConditional(std::string_view if_none_match,
+                        std::string_view if_modified_since) {
+        if_none_match_ = if_none_match;
+        if_modified_since_ = if_modified_since;
+    }
+    // Range 和 If-Range，同样只在 MakeResponse 期间使用
+    void SetRange(std::string_view range, std::string_view if_range) {
+        range_ = range;
+        if_range_ = if_range;
+    }
+    // HEAD 请求：头部 (包括 Content-length) 和 GET 相同，不带响应体
+    void OmitBody() { omit_body_ = true; }
+    // 按后缀得到文件的 Content-type
+    static std::string_view FileType(std::string_view path);
+    // 读取 src_dir 下的 <code>.html 作为各错误码的响应，
+    // 没有时生成一个简单的页面；需在处理请求之前调用
+    static void LoadErrorPages(const std::string &src_dir);
+    // 解析 Accept-Encoding，返回可接受的 FileCache::ACCEPT_* 组合
+    static int AcceptEncoding(std::string_view value);
 
   private:
     void AddStateLine(Buffer &buff);
-    void AddHeader(Buffer &buff);
     void AddContent(Buffer &buff);
-    void ErrorHtml();
-    std::string GetFileType();
+    void AddRanges(Buffer &buff);
+    void EndSegment(Buffer &buff, int i);
+    bool NotModified() const;
+    bool IfRangeMatch() const;
+    int ParseRange(std::string_view spec, size_t size);
+    static bool MatchETag(std::string_view list, std::string_view etag);
+    static bool ParseHttpDate(std::string_view str, time_t *t);
+    static int StatusIndex(int code);
+    static std::string ErrorContent(int index, const std::string &html);
     int code_;
     bool is_keep_alive_;
-    std::string path_;
-    std::string src_dir_;
-    char *mm_file_;
-    struct stat mm_file_stat_;
-    static const std::unordered_map<std::string, std::string> suffix_type;
-    static const std::unordered_map<int, std::string> code_status;
-    static const std::unordered_map<int, std::string> code_path;
+    bool omit_body_;
+    int accept_encoding_;
+    std::string_view if_none_match_;
+    std::string_view if_modified_since_;
+    std::string_view range_;
+    std::string_view if_range_;
+    Segment segs_[MAX_RANGES];
+    int seg_cnt_;
+    size_t tail_len_;
+    // 当前片段的文本开始时缓冲区的 ReadableBytes
+    size_t buff_mark_;
+    std::string path_; // 文件的完整路径，重复使用已分配的空间
+    FileCache::EntryPtr file_;
+    // 错误响应的头部和正文，下标与状态行表相同
+    static std::string error_page_[];
 };
 
 #endif //__HTTPRESPONSE_H__
\ No newline at end of file
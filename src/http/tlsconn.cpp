@@ -0,0 +1,186 @@
+#include "tlsconn.h"
+
+using namespace std;
+
+// 会话缓存的条目数和会话的有效期
+static const long SESSION_CACHE_SIZE = 20480;
+static const long SESSION_TIMEOUT_S = 3600;
+
+// 客户端引起的错误 (如握手失败) 只记为警告
+static void LogSslError(const char *what, bool warn = false) {
+    char err[256];
+    ERR_error_string_n(ERR_get_error(), err, sizeof(err));
+    if (warn) {
+        LOG_WARN("%s: %s", what, err);
+    } else {
+        LOG_ERROR("%s: %s", what, err);
+    }
+    ERR_clear_error();
+}
+
+TlsContext *TlsContext::Instance() {
+    static TlsContext context;
+    return &context;
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx_); }
+
+bool TlsContext::Init(const char *cert_file, const char *key_file) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        LogSslError("SSL_CTX_new error");
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // 客户端常不发送 close_notify 直接断开，按正常关闭处理
+    SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION |
+                                 SSL_OP_CIPHER_SERVER_PREFERENCE |
+                                 SSL_OP_IGNORE_UNEXPECTED_EOF
+#ifndef OPENSSL_NO_KTLS
+                                 | SSL_OP_ENABLE_KTLS
+#endif
+    );
+    // 允许部分写入，重试时缓冲区可以移动 (Buffer 扩容)；
+    // 空闲连接释放读写缓冲区
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                              SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+    // 会话 ID 在进程内缓存，会话票据由 OpenSSL 生成的密钥加密，
+    // 两种方式恢复的会话都只在本进程内有效
+    static const unsigned char SID_CTX[] = "myserver";
+    SSL_CTX_set_session_id_context(ctx, SID_CTX, sizeof(SID_CTX) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT_S);
+    SSL_CTX_set_alpn_select_cb(ctx, &TlsContext::SelectAlpn, nullptr);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file) != 1) {
+        LogSslError("Load certificate error");
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        LogSslError("Load private key error");
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    SSL_CTX_free(ctx_);
+    ctx_ = ctx;
+    return true;
+}
+
+// 按我们的顺序选择客户端也支持的第一个协议，都不支持时不协商，
+// 按 HTTP/1.1 处理
+int TlsContext::SelectAlpn(SSL *, const unsigned char **out,
+                           unsigned char *outlen, const unsigned char *in,
+                           unsigned int inlen, void *) {
+    static const unsigned char PROTOS[] = "\x02h2\x08http/1.1";
+    unsigned char *selected;
+    if (SSL_select_next_proto(&selected, outlen, PROTOS, sizeof(PROTOS) - 1,
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+TlsConn *TlsContext::NewConn(int fd) {
+    assert(ctx_);
+    SSL *ssl = SSL_new(ctx_);
+    if (ssl && SSL_set_fd(ssl, fd) == 1) {
+        SSL_set_accept_state(ssl);
+    } else {
+        LogSslError("SSL_new error");
+        SSL_free(ssl);
+        ssl = nullptr;
+    }
+    return new TlsConn(ssl);
+}
+
+// ssl 为空 (创建失败) 时读写都返回错误，连接随之关闭
+TlsConn::TlsConn(SSL *ssl)
+    : ssl_(ssl), established_(false), kernel_send_(false),
+      failed_(ssl == nullptr) {}
+
+TlsConn::~TlsConn() { SSL_free(ssl_); }
+
+ssize_t TlsConn::Read(Buffer *buff, int *saveErrno) {
+    if (failed_) {
+        *saveErrno = EPROTO;
+        return -1;
+    }
+    if (!established_) {
+        // 服务端的握手消息很小，不会写满 socket 的发送缓冲区，
+        // 握手只需要在可读时推进
+        int ret = SSL_do_handshake(ssl_);
+        if (ret != 1) {
+            return Fail(ret, saveErrno);
+        }
+        established_ = true;
+#ifndef OPENSSL_NO_KTLS
+        kernel_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#endif
+        LOG_DEBUG("TLS fd:%d %s %s resumed:%d kTLS send:%d",
+                  SSL_get_fd(ssl_), SSL_get_version(ssl_),
+                  SSL_get_cipher_name(ssl_), SSL_session_reused(ssl_),
+                  kernel_send_);
+    }
+    // 读入尾块剩余的空间，放不下整个记录时接着读入新的块，直到 SSL 中
+    // 没有已解密未取走的数据，水平触发时不会漏掉可读事件
+    ssize_t total = 0;
+    do {
+        buff->EnsureWriteable(1);
+        int len = SSL_read(ssl_, buff->BeginWrite(), buff->WriteableBytes());
+        if (len <= 0) {
+            return total > 0 ? total : Fail(len, saveErrno);
+        }
+        buff->HashWritten(len);
+        total += len;
+    } while (SSL_pending(ssl_) > 0);
+    return total;
+}
+
+ssize_t TlsConn::Write(const char *data, size_t len, int *saveErrno) {
+    if (failed_) {
+        *saveErrno = EPROTO;
+        return -1;
+    }
+    int ret = SSL_write(ssl_, data, len < RECORD_SIZE ? len : RECORD_SIZE);
+    if (ret <= 0) {
+        return Fail(ret, saveErrno);
+    }
+    return ret;
+}
+
+void TlsConn::Shutdown() {
+    if (established_ && !failed_) {
+        SSL_shutdown(ssl_);
+    }
+    ERR_clear_error();
+}
+
+// 把 SSL 的错误转换成 ReadFd/writev 的约定
+ssize_t TlsConn::Fail(int ret, int *saveErrno) {
+    switch (SSL_get_error(ssl_, ret)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        *saveErrno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        // 对端关闭了 TLS 连接
+        *saveErrno = 0;
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        failed_ = true;
+        *saveErrno = errno ? errno : ECONNRESET;
+        ERR_clear_error();
+        return -1;
+    default:
+        failed_ = true;
+        LogSslError(established_ ? "TLS error" : "TLS handshake error",
+                    true);
+        *saveErrno = EPROTO;
+        return -1;
+    }
+}
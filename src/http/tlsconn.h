@@ -0,0 +1,70 @@
+#ifndef __TLSCONN_H__
+#define __TLSCONN_H__
+
+#include "../buffer/buffer.hpp"
+#include "../log/log.h"
+#include <errno.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <sys/types.h>
+
+class TlsConn;
+
+// 进程内共享的 OpenSSL 服务端上下文，Init 成功之后新连接都使用 TLS
+// 会话缓存和会话票据都开启，客户端可以恢复会话，跳过证书验证和密钥交换
+// 设置了 SSL_OP_ENABLE_KTLS，握手完成后 OpenSSL 尝试把记录层的密钥交给
+// 内核 (kTLS)，之后 socket 上的 writev 和 sendfile 由内核加密
+// ALPN 中优先选择 h2，连接前言之后的处理和明文的 HTTP/2 相同
+// 可在任意线程中使用
+class TlsContext {
+  public:
+    static TlsContext *Instance();
+    // 加载 PEM 格式的证书链和私钥，失败时返回 false
+    bool Init(const char *cert_file, const char *key_file);
+    bool Enabled() const { return ctx_ != nullptr; }
+    // 为新连接创建 TLS 状态，以服务端身份等待握手
+    TlsConn *NewConn(int fd);
+
+  private:
+    TlsContext() : ctx_(nullptr) {}
+    ~TlsContext();
+    static int SelectAlpn(SSL *ssl, const unsigned char **out,
+                          unsigned char *outlen, const unsigned char *in,
+                          unsigned int inlen, void *arg);
+
+    SSL_CTX *ctx_;
+};
+
+// 单个连接的 TLS 状态，只由处理该连接的线程访问
+// 读总是经过 SSL_read；写出时内核已接管加密 (KernelSend) 则由 HttpConn
+// 直接 writev/sendfile，否则在用户态加密后写出
+class TlsConn {
+  public:
+    // 一个 TLS 记录的最大明文长度
+    static const size_t RECORD_SIZE = 16384;
+
+    explicit TlsConn(SSL *ssl);
+    ~TlsConn();
+    // 握手未完成时先继续握手，之后把解密的数据追加到 buff
+    // 返回值和 errno 的约定同 Buffer::ReadFd，握手未完成或没有数据时
+    // 返回 -1 且 errno 为 EAGAIN，对端发送 close_notify 时返回 0
+    ssize_t Read(Buffer *buff, int *saveErrno);
+    // 用户态加密并写出 data 的开头，最多一个记录，返回写出的明文字节数
+    // 返回 -1 且 errno 为 EAGAIN 时，下次必须以相同的数据开头重试
+    ssize_t Write(const char *data, size_t len, int *saveErrno);
+    // 握手完成且内核负责加密发送
+    bool KernelSend() const { return kernel_send_; }
+    // 发送 close_notify，不等待对端回应
+    void Shutdown();
+
+  private:
+    ssize_t Fail(int ret, int *saveErrno);
+
+    SSL *ssl_;
+    bool established_;
+    bool kernel_send_;
+    // 发生过致命错误，之后不能再发送 close_notify
+    bool failed_;
+};
+
+#endif //__TLSCONN_H__
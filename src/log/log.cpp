@@ -73,11 +73,9 @@ void Log::init(int level, const char *path, const char *suffix,
 }
 
 void Log::write(int level, const char *format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t t_sec = now.tv_sec;
-    struct tm *sys_time = localtime(&t_sec);
-    struct tm t = *sys_time;
+    // 时间来自线程本地的缓存，每秒才做一次 localtime 和格式化
+    const CoarseClock::WallTime &wall = CoarseClock::Wall();
+    const struct tm &t = wall.local;
     va_list va_list_local;
     if (today_ != t.tm_mday ||
         (line_count_ && (line_count_ % MAX_LINES == 0))) {
@@ -105,16 +103,23 @@ void Log::write(int level, const char *format, ...) {
     {
         std::unique_lock<std::mutex> lock(mtx_);
         line_count_++;
-        int n = snprintf(buffer_.BeginWrite(), 28,
-                         "%d-%02d-%02d %02d:%02d:%02d.%06ld ", t.tm_year + 1900,
-                         t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
-                         now.tv_usec);
+        int n = snprintf(buffer_.BeginWrite(), 28, "%s.%06ld ", wall.log_time,
+                         wall.usec);
         buffer_.HashWritten(n);
         AppendLogLevelTitle(level);
         va_start(va_list_local, format);
         int m = vsnprintf(buffer_.BeginWrite(), buffer_.WriteableBytes(),
                           format, va_list_local);
         va_end(va_list_local);
+        // vsnprintf 返回的是完整长度，超出部分已被截断
+        m = std::max(0, std::min<int>(m, buffer_.WriteableBytes() - 1));
+        // 消息中可能带有请求数据，换行替换为空格，保证一条日志只占一行
+        char *msg = buffer_.BeginWrite();
+        const char *p = Scan::FindAnyOf(msg, msg + m, "\r\n", 2);
+        while (p != msg + m) {
+            msg[p - msg] = ' ';
+            p = Scan::FindAnyOf(p + 1, msg + m, "\r\n", 2);
+        }
 
         buffer_.HashWritten(m);
         buffer_.Append("\n\0", 2);
@@ -130,19 +135,19 @@ void Log::write(int level, const char *format, ...) {
 void Log::AppendLogLevelTitle(int level) {
     switch (level) {
     case 0:
-        buffer_.Append("[debug]:", 9);
+        buffer_.Append("[debug]: ", 9);
         break;
     case 1:
-        buffer_.Append("[info]:", 9);
+        buffer_.Append("[info] : ", 9);
         break;
     case 2:
-        buffer_.Append("[warn]:", 9);
+        buffer_.Append("[warn] : ", 9);
         break;
     case 3:
-        buffer_.Append("[error]:", 9);
+        buffer_.Append("[error]: ", 9);
         break;
     default:
-        buffer_.Append("[info]:", 9);
+        buffer_.Append("[info] : ", 9);
         break;
     }
 }
@@ -1,8 +1,10 @@
 #ifndef __LOG_H__
 #define __LOG_H__
 
-#include "../buffer/buffer.h"
+#include "../buffer/buffer.hpp"
+#include "../timer/coarseclock.h"
 #include "blockqueue.hpp"
+#include <algorithm>
 #include <assert.h>
 #include <mutex>
 #include <stdarg.h>
@@ -39,7 +41,8 @@ class Log {
     int line_count_;
     int today_;
     bool is_open_;
-    Buffer buffer_;
+    // 只在 mtx_ 内使用；单例在线程退出之后才析构，存储不经过块池
+    BasicBuffer<size_t, 1024, HeapGrowth> buffer_;
     int level_;
     bool is_async_;
     FILE *fp_;
@@ -0,0 +1,54 @@
+#ifndef __MPSCQUEUE_HPP__
+#define __MPSCQUEUE_HPP__
+
+#include <atomic>
+
+// 侵入式节点，放入队列的对象需要继承它
+struct MpscNode {
+    MpscNode *mpsc_next_ = nullptr;
+};
+
+// 无锁多生产者单消费者队列
+// 生产者用 CAS 压栈，消费者一次取走整条链表并反转成先进先出的顺序
+// 节点由对象自身提供，入队不分配内存；同一对象同一时刻只能在队列中出现一次
+template <class T> class MpscQueue {
+  public:
+    MpscQueue() : head_(nullptr) {}
+    ~MpscQueue() = default;
+
+    // 可在任意线程调用，返回 true 表示入队前队列为空，调用方需要唤醒消费者
+    bool Push(T *item) {
+        MpscNode *node = item;
+        MpscNode *head = head_.load(std::memory_order_relaxed);
+        do {
+            node->mpsc_next_ = head;
+        } while (!head_.compare_exchange_weak(head, node,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+        return head == nullptr;
+    }
+
+    // 只能在消费者线程调用，按入队顺序对每个元素调用 f
+    // f 中可以把元素重新入队
+    template <class F> void Consume(F &&f) {
+        MpscNode *node = head_.exchange(nullptr, std::memory_order_acquire);
+        MpscNode *prev = nullptr;
+        while (node) {
+            MpscNode *next = node->mpsc_next_;
+            node->mpsc_next_ = prev;
+            prev = node;
+            node = next;
+        }
+        while (prev) {
+            MpscNode *next = prev->mpsc_next_;
+            prev->mpsc_next_ = nullptr;
+            f(static_cast<T *>(prev));
+            prev = next;
+        }
+    }
+
+  private:
+    std::atomic<MpscNode *> head_;
+};
+
+#endif //__MPSCQUEUE_HPP__
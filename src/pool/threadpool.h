@@ -1,18 +1,29 @@
 #ifndef __THREADPOOL_H__
 #define __THREADPOOL_H__
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 
+// 任务队列的准入控制参考 CoDel：记录每个任务在队列中的等待时间 (sojourn)，
+// 等待时间持续 interval 都高于 target 时认为过载，等待时间回落后解除
 class ThreadPool {
   public:
-    explicit ThreadPool(size_t thread_count = 8)
+    typedef std::chrono::steady_clock Clock;
+
+    explicit ThreadPool(size_t thread_count = 8, int target_MS = 5,
+                        int interval_MS = 100)
         : pool_(std::make_shared<Pool>()) {
         assert(thread_count > 0);
+        pool_->target_ = std::chrono::milliseconds(target_MS);
+        pool_->interval_ = std::chrono::milliseconds(interval_MS);
         for (size_t i = 0; i < thread_count; i++) {
             std::thread([pool = pool_] {
                 std::unique_lock<std::mutex> lock(pool->mtx_);
@@ -20,8 +31,9 @@ class ThreadPool {
                     if (!pool->tasks.empty()) {
                         auto task = std::move(pool->tasks.front());
                         pool->tasks.pop();
+                        pool->UpdateDelay(Clock::now() - task.second);
                         lock.unlock();
-                        task();
+                        task.first();
                         lock.lock();
                     } else if (pool->is_close_)
                         break;
@@ -46,17 +58,63 @@ class ThreadPool {
     template <class F> void AddTask(F &&task) {
         {
             std::lock_guard<std::mutex> lock(pool_->mtx_);
-            pool_->tasks.emplace(std::forward<F>(task));
+            pool_->tasks.emplace(std::forward<F>(task), Clock::now());
         }
         pool_->cond_.notify_one();
     }
 
+    // 当前排队时延：最近出队任务的等待时间与队首任务已等待时间中的较大者
+    int64_t QueueDelayUS() {
+        std::lock_guard<std::mutex> lock(pool_->mtx_);
+        int64_t delay = pool_->delay_us_;
+        if (!pool_->tasks.empty()) {
+            delay = std::max<int64_t>(delay, ToUS(Clock::now() -
+                                                  pool_->tasks.front().second));
+        }
+        return delay;
+    }
+
+    // 过载时应拒绝新连接，已在处理中的请求继续完成
+    bool IsOverloaded() {
+        if (pool_->overloaded_) {
+            return true;
+        }
+        // 工作线程全部阻塞时不会有任务出队，直接检查队首任务
+        std::lock_guard<std::mutex> lock(pool_->mtx_);
+        return !pool_->tasks.empty() &&
+               Clock::now() - pool_->tasks.front().second >
+                   pool_->target_ + pool_->interval_;
+    }
+
   private:
+    static int64_t ToUS(Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+
     struct Pool {
         std::mutex mtx_;
         std::condition_variable cond_;
-        bool is_close_;
-        std::queue<std::function<void()>> tasks;
+        bool is_close_ = false;
+        std::queue<std::pair<std::function<void()>, Clock::time_point>> tasks;
+        Clock::duration target_;
+        Clock::duration interval_;
+        // 等待时间第一次超过 target 之后再过 interval 的时刻，未超过时为空
+        Clock::time_point first_above_;
+        std::atomic<bool> overloaded_{false};
+        std::atomic<int64_t> delay_us_{0};
+
+        // 持有 mtx_ 时调用
+        void UpdateDelay(Clock::duration sojourn) {
+            delay_us_ = ToUS(sojourn);
+            if (sojourn < target_ || tasks.empty()) {
+                first_above_ = Clock::time_point();
+                overloaded_ = false;
+            } else if (first_above_ == Clock::time_point()) {
+                first_above_ = Clock::now() + interval_;
+            } else if (Clock::now() >= first_above_) {
+                overloaded_ = true;
+            }
+        }
     };
     std::shared_ptr<Pool> pool_;
 };
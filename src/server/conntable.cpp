@@ -0,0 +1,33 @@
+#include "conntable.h"
+
+ConnTable::ConnTable(int max_fd)
+    : max_fd_(max_fd),
+      chunks_(new std::atomic<HttpConn *>[(max_fd + CHUNK_MASK) >>
+                                          CHUNK_SHIFT]) {
+    assert(max_fd > 0);
+    for (int i = 0; i < (max_fd_ + CHUNK_MASK) >> CHUNK_SHIFT; i++) {
+        chunks_[i] = nullptr;
+    }
+}
+
+ConnTable::~ConnTable() {
+    for (int i = 0; i < (max_fd_ + CHUNK_MASK) >> CHUNK_SHIFT; i++) {
+        delete[] chunks_[i].load();
+    }
+}
+
+HttpConn *ConnTable::Acquire(int fd) {
+    if (fd < 0 || fd >= max_fd_) {
+        return nullptr;
+    }
+    HttpConn *client = Get(fd);
+    if (client) {
+        return client;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::atomic<HttpConn *> &chunk = chunks_[fd >> CHUNK_SHIFT];
+    if (!chunk.load(std::memory_order_relaxed)) {
+        chunk.store(new HttpConn[CHUNK_SIZE], std::memory_order_release);
+    }
+    return Get(fd);
+}
@@ -0,0 +1,41 @@
+#ifndef __CONNTABLE_H__
+#define __CONNTABLE_H__
+
+#include "../http/httpconn.h"
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// 以 fd 为下标的连接表，所有事件循环共享
+// 按块分配 HttpConn，块一旦分配就不再释放，连接地址在整个生命周期内不变
+// 查找只是一次数组访问，没有哈希，也不会因为扩容让工作线程手里的指针失效
+class ConnTable {
+  public:
+    explicit ConnTable(int max_fd);
+    ~ConnTable();
+    // 为新连接取得 fd 对应的槽位，块未分配时先分配，fd 超出范围返回 nullptr
+    HttpConn *Acquire(int fd);
+    // 事件分发时使用，槽位所在的块未分配时返回 nullptr
+    HttpConn *Get(int fd) const {
+        if (fd < 0 || fd >= max_fd_) {
+            return nullptr;
+        }
+        HttpConn *chunk =
+            chunks_[fd >> CHUNK_SHIFT].load(std::memory_order_acquire);
+        return chunk ? &chunk[fd & CHUNK_MASK] : nullptr;
+    }
+    int MaxFd() const { return max_fd_; }
+
+  private:
+    static const int CHUNK_SHIFT = 8;
+    static const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static const int CHUNK_MASK = CHUNK_SIZE - 1;
+
+    int max_fd_;
+    std::unique_ptr<std::atomic<HttpConn *>[]> chunks_;
+    // 只在分配新块时使用
+    std::mutex mtx_;
+};
+
+#endif //__CONNTABLE_H__
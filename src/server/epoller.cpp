@@ -7,19 +7,23 @@ Epoller::Epoller(int max_event)
 
 Epoller::~Epoller() { close(epoll_fd_); }
 
-bool Epoller::AddFd(int fd, uint32_t events) {
+bool Epoller::AddFd(int fd, uint32_t events, uint32_t tag) {
     if (fd < 0)
         return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    // 低 32 位存 fd，高 32 位存 tag
+    ev.data.u64 =
+        (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
     ev.events = events;
     return 0 == epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
 }
-bool Epoller::ModFd(int fd, uint32_t events) {
+bool Epoller::ModFd(int fd, uint32_t events, uint32_t tag) {
     if (fd < 0)
         return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    // 低 32 位存 fd，高 32 位存 tag
+    ev.data.u64 =
+        (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
     ev.events = events;
     return 0 == epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -37,7 +41,12 @@ int Epoller::Wait(int time_out_MS) {
 
 int Epoller::GetEventFd(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(events_[i].data.u64 & 0xffffffff);
+}
+
+uint32_t Epoller::GetEventTag(size_t i) const {
+    assert(i < events_.size());
+    return static_cast<uint32_t>(events_[i].data.u64 >> 32);
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {
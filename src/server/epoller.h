@@ -2,6 +2,7 @@
 #define __EPOLLER_H__
 
 #include <assert.h>
+#include "poller.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
@@ -9,16 +10,18 @@
 #include <vector>
 
 // 对 epoll 的简单封装
-class Epoller {
+class Epoller : public Poller {
   public:
     explicit Epoller(int max_event = 1024);
-    ~Epoller();
-    bool AddFd(int fd, uint32_t events);
-    bool ModFd(int fd, uint32_t events);
-    bool DelFd(int fd);
-    int Wait(int time_out_MS = -1);
-    int GetEventFd(size_t i) const;
-    uint32_t GetEvents(size_t i) const;
+    ~Epoller() override;
+    bool AddFd(int fd, uint32_t events, uint32_t tag = 0) override;
+    bool ModFd(int fd, uint32_t events, uint32_t tag = 0) override;
+    bool DelFd(int fd) override;
+    int Wait(int time_out_MS = -1) override;
+    int GetEventFd(size_t i) const override;
+    uint32_t GetEventTag(size_t i) const override;
+    uint32_t GetEvents(size_t i) const override;
+    const char *Name() const override { return "epoll"; }
 
   private:
     // epoll 实例，用 epoll_fd_ 来增改删 fd
@@ -0,0 +1,437 @@
+#include "eventloop.h"
+
+EventLoop::EventLoop(ConnTable *users, int time_out_MS, uint32_t conn_event,
+                     ThreadPool *pool, bool use_uring)
+    : users_(users), time_out_MS_(time_out_MS), conn_event_(conn_event),
+      owner_mode_(!(conn_event & EPOLLONESHOT)), quit_(false),
+      conn_count_(0), listen_fd_(-1), pool_(pool), timer_(new TimingWheel()),
+      timer_fd_(-1), timer_armed_MS_(-1),
+      poller_(Poller::NewPoller(use_uring)) {
+    // TLS 连接需要 OpenSSL 自己读 socket
+    recv_mode_ = !pool_ && poller_->CanRecv() &&
+                 !TlsContext::Instance()->Enabled();
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(wakeup_fd_ >= 0);
+    poller_->AddFd(wakeup_fd_, EPOLLIN);
+    if (time_out_MS_ > 0) {
+        timer_fd_ =
+            timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        assert(timer_fd_ >= 0);
+        poller_->AddFd(timer_fd_, EPOLLIN);
+    }
+}
+
+EventLoop::~EventLoop() {
+    poller_->DelFd(wakeup_fd_);
+    close(wakeup_fd_);
+    if (timer_fd_ >= 0) {
+        poller_->DelFd(timer_fd_);
+        close(timer_fd_);
+    }
+    for (auto &item : pending_) {
+        close(item.first);
+    }
+}
+
+void EventLoop::Loop() {
+    CoarseClock::Update();
+    while (!quit_) {
+        if (timer_fd_ >= 0) {
+            ArmTimer();
+        }
+        int event_count = poller_->Wait(-1);
+        // 本轮的超时、日志和响应头都使用这次刷新的时间
+        CoarseClock::Update();
+        for (int i = 0; i < event_count; i++) {
+            // 处理事件
+            int fd = poller_->GetEventFd(i);
+            uint32_t events = poller_->GetEvents(i);
+            int kind = poller_->GetEventKind(i);
+            if (fd == listen_fd_) {
+                if (kind == Poller::EV_ACCEPT) {
+                    accepted_cb_(poller_->GetEventResult(i));
+                } else {
+                    accept_cb_();
+                }
+                continue;
+            } else if (fd == wakeup_fd_) {
+                HandleWakeup();
+                continue;
+            } else if (fd == timer_fd_) {
+                HandleTimer();
+                continue;
+            }
+            HttpConn *client = users_->Get(fd);
+            assert(client);
+            if (client->Gen() != poller_->GetEventTag(i)) {
+                // fd 已关闭并被新连接复用，丢弃旧连接的事件
+                continue;
+            }
+            if (kind == Poller::EV_RECV) {
+                OnRecv(client, poller_->GetEventData(i),
+                       poller_->GetEventResult(i));
+            } else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                CloseConn(client);
+            } else if (recv_mode_) {
+                // 之前没写完的响应可以继续写了
+                ExtentTime(client);
+                Serve(client);
+            } else if (owner_mode_) {
+                DealEvent(client, events);
+            } else if (events & EPOLLIN) {
+                DealRead(client);
+            } else if (events & EPOLLOUT) {
+                DealWrite(client);
+            } else {
+                LOG_ERROR("Unexpected event");
+            }
+        }
+    }
+}
+
+void EventLoop::Quit() {
+    quit_ = true;
+    Wakeup();
+}
+
+bool EventLoop::SetAcceptor(int listen_fd, uint32_t listen_event,
+                            const std::function<void()> &cb,
+                            const std::function<void(int)> &on_accepted) {
+    listen_fd_ = listen_fd;
+    accept_cb_ = cb;
+    accepted_cb_ = on_accepted;
+    if (accepted_cb_ && poller_->AcceptMulti(listen_fd)) {
+        return true;
+    }
+    return poller_->AddFd(listen_fd, listen_event);
+}
+
+void EventLoop::AddClient(int fd, sockaddr_in addr) {
+    assert(fd > 0);
+    conn_count_++;
+    InitClient(fd, addr);
+}
+
+void EventLoop::InitClient(int fd, sockaddr_in addr) {
+    HttpConn *client = users_->Acquire(fd);
+    if (!client) {
+        LOG_WARN("Client[%d] out of conn table!", fd);
+        close(fd);
+        conn_count_--;
+        return;
+    }
+    client->Init(fd, addr);
+    if (time_out_MS_ > 0) {
+        timer_->Add(client->Timer(), time_out_MS_, &EventLoop::OnTimeout, this,
+                    client);
+    }
+    if (recv_mode_) {
+        poller_->Recv(fd, client->Gen());
+        LOG_INFO("Client[%d] in!", client->GetFd());
+        return;
+    }
+    uint32_t events = EPOLLIN | conn_event_;
+    if (owner_mode_) {
+        events |= EPOLLOUT;
+    }
+    poller_->AddFd(fd, events, client->Gen());
+    LOG_INFO("Client[%d] in!", client->GetFd());
+}
+
+void EventLoop::QueueClient(int fd, sockaddr_in addr) {
+    assert(fd > 0);
+    conn_count_++;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        pending_.emplace_back(fd, addr);
+    }
+    Wakeup();
+}
+
+void EventLoop::Wakeup() {
+    uint64_t one = 1;
+    ssize_t n = write(wakeup_fd_, &one, sizeof(one));
+    if (n != sizeof(one)) {
+        LOG_ERROR("EventLoop wakeup error!");
+    }
+}
+
+void EventLoop::HandleWakeup() {
+    uint64_t count = 0;
+    ssize_t n = read(wakeup_fd_, &count, sizeof(count));
+    if (n != sizeof(count)) {
+        return;
+    }
+    std::vector<std::pair<int, sockaddr_in>> clients;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        clients.swap(pending_);
+    }
+    for (auto &item : clients) {
+        InitClient(item.first, item.second);
+    }
+    done_.Consume(
+        [this](HttpConn *client) { HandleDone(client, client->Done()); });
+}
+
+void EventLoop::HandleTimer() {
+    uint64_t count = 0;
+    ssize_t n = read(timer_fd_, &count, sizeof(count));
+    if (n != sizeof(count)) {
+        return;
+    }
+    // 一次性定时，到期后即失效
+    // 粗粒度时钟可能略落后于 timerfd，至少推进到设定的到期时间
+    int64_t fired = timer_armed_MS_;
+    timer_armed_MS_ = -1;
+    timer_->Tick(std::max(CoarseClock::NowMS(), fired));
+}
+
+// 每轮等待前按时间轮中最近的槽设置 timerfd，时间不变时不做系统调用
+void EventLoop::ArmTimer() {
+    int64_t next = timer_->NextTickMS();
+    if (next == timer_armed_MS_) {
+        return;
+    }
+    timer_armed_MS_ = next;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next >= 0) {
+        its.it_value.tv_sec = next / 1000;
+        its.it_value.tv_nsec = (next % 1000) * 1000000L;
+    }
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr);
+}
+
+void EventLoop::OnTimeout(void *loop, void *client) {
+    static_cast<EventLoop *>(loop)->CloseConn(static_cast<HttpConn *>(client));
+}
+
+// 只在循环线程中调用
+void EventLoop::CloseConn(HttpConn *client) {
+    assert(client);
+    if (client->IsClose()) {
+        return;
+    }
+    if (client->IsOwned()) {
+        // 工作线程还在处理，等连接交回后再关闭
+        client->AddPending(EPOLLHUP);
+        return;
+    }
+    LOG_INFO("Client[%d] quit!", client->GetFd());
+    timer_->Cancel(client->Timer());
+    poller_->DelFd(client->GetFd());
+    client->Close();
+    conn_count_--;
+}
+
+void EventLoop::DealRead(HttpConn *client) {
+    assert(client);
+    ExtentTime(client);
+    Dispatch(client, std::bind(&EventLoop::OnRead, this, client));
+}
+
+void EventLoop::DealWrite(HttpConn *client) {
+    assert(client);
+    ExtentTime(client);
+    Dispatch(client, std::bind(&EventLoop::OnWrite, this, client));
+}
+
+void EventLoop::ExtentTime(HttpConn *client) {
+    assert(client);
+    if (time_out_MS_ > 0) {
+        timer_->Adjust(client->Timer(), time_out_MS_);
+    }
+}
+
+// 有线程池时交给工作线程，连接在交回之前归工作线程所有
+void EventLoop::Dispatch(HttpConn *client, const std::function<void()> &task) {
+    if (pool_) {
+        client->SetOwned(true);
+        pool_->AddTask(task);
+    } else {
+        task();
+    }
+}
+
+// 在处理连接的线程中调用，之后该线程不能再访问 client
+void EventLoop::Complete(HttpConn *client, int done) {
+    if (done != CLOSE) {
+        client->Settle();
+    }
+    if (!pool_) {
+        HandleDone(client, done);
+        return;
+    }
+    client->SetDone(done);
+    if (done_.Push(client)) {
+        Wakeup();
+    }
+}
+
+// 只在循环线程中调用
+void EventLoop::HandleDone(HttpConn *client, int done) {
+    client->SetOwned(false);
+    uint32_t pending = client->TakePending();
+    if (done == CLOSE || (pending & EPOLLHUP)) {
+        CloseConn(client);
+        return;
+    }
+    switch (done) {
+    case WANT_READ:
+        poller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN, client->Gen());
+        break;
+    case WANT_WRITE:
+        poller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT, client->Gen());
+        break;
+    default:
+        // 归属期间到来的事件
+        if (pending) {
+            Dispatch(client,
+                     std::bind(&EventLoop::RunOwned, this, client, pending));
+        }
+        break;
+    }
+}
+
+void EventLoop::OnRead(HttpConn *client) {
+    assert(client);
+    int ret = -1;
+    int readErrno = 0;
+    ret = client->Read(&readErrno);
+    if (ret <= 0 && readErrno != EAGAIN) {
+        Complete(client, CLOSE);
+        return;
+    }
+    OnProcess(client);
+}
+
+void EventLoop::OnProcess(HttpConn *client) {
+    Complete(client, client->Process() ? WANT_WRITE : WANT_READ);
+}
+
+// 响应已经排队，这里只需要执行 client->Write 把它们写入到 fd 中即可
+// 写完后继续处理读缓冲区中剩余的请求
+void EventLoop::OnWrite(HttpConn *client) {
+    assert(client);
+    int ret = -1;
+    int writeErrno = 0;
+    ret = client->Write(&writeErrno);
+    if (client->ToWriteBytes() == 0) {
+        /* 传输完成 */
+        if (client->IsKeepAlive()) {
+            OnProcess(client);
+            return;
+        }
+    } else if (ret > 0 || writeErrno == EAGAIN) {
+        /* 继续传输，非 ET 模式下 Write 可能只写出一部分就返回 */
+        Complete(client, WANT_WRITE);
+        return;
+    }
+    Complete(client, CLOSE);
+}
+
+// 以下用于连接归属模式，fd 的注册不再改变
+void EventLoop::DealEvent(HttpConn *client, uint32_t events) {
+    assert(client);
+    ExtentTime(client);
+    if (client->IsOwned()) {
+        // 工作线程交回连接后再处理
+        client->AddPending(events);
+        return;
+    }
+    Dispatch(client, std::bind(&EventLoop::RunOwned, this, client, events));
+}
+
+void EventLoop::RunOwned(HttpConn *client, uint32_t events) {
+    Complete(client, OnEvent(client, events));
+}
+
+// 返回 DONE 或 CLOSE
+int EventLoop::OnEvent(HttpConn *client, uint32_t events) {
+    int done = DONE;
+    // 上一个响应还没写完，先继续写
+    if (client->ToWriteBytes() > 0 && !FlushConn(client, &done)) {
+        return done;
+    }
+    // 上次读取在高水位暂停时没有新的边沿，需要主动继续读
+    bool want_read = (events & EPOLLIN) || client->IsReadPaused();
+    do {
+        if (want_read) {
+            int readErrno = 0;
+            ssize_t ret = client->Read(&readErrno);
+            if (ret <= 0 && readErrno != EAGAIN) {
+                return CLOSE;
+            }
+        }
+        // 直接尝试写出响应，写不完时等待下一次 EPOLLOUT 边沿
+        while (client->Process()) {
+            if (!FlushConn(client, &done)) {
+                return done;
+            }
+        }
+    } while (client->IsReadPaused());
+    return DONE;
+}
+
+// 返回 true 表示响应已写完且连接保持，否则 done 为 DONE (等待可写) 或 CLOSE
+bool EventLoop::FlushConn(HttpConn *client, int *done) {
+    int writeErrno = 0;
+    ssize_t ret = client->Write(&writeErrno);
+    if (client->ToWriteBytes() == 0) {
+        if (client->IsKeepAlive()) {
+            return true;
+        }
+    } else if (ret > 0 || writeErrno == EAGAIN) {
+        *done = DONE;
+        return false;
+    }
+    *done = CLOSE;
+    return false;
+}
+
+// 以下用于完成式读取，只在循环线程中调用
+// len 为读取的结果，0 表示对端关闭，负数为 -errno
+void EventLoop::OnRecv(HttpConn *client, const char *data, int len) {
+    if (len <= 0) {
+        CloseConn(client);
+        return;
+    }
+    ExtentTime(client);
+    client->Receive(data, len);
+    if (static_cast<size_t>(len) == poller_->RecvSize()) {
+        // 读满了一个缓冲区，多半是大的请求体，剩下的直接 readv，
+        // 和就绪模式一样读到 EAGAIN 或高水位
+        int readErrno = 0;
+        ssize_t ret = client->Read(&readErrno);
+        if (ret <= 0 && readErrno != EAGAIN) {
+            CloseConn(client);
+            return;
+        }
+    }
+    Serve(client);
+}
+
+// 处理读缓冲区中的请求并尽量写出响应，写不完时监听一次可写
+// 读缓冲区达到高水位时暂停读取，写出响应、解析掉请求后再继续
+void EventLoop::Serve(HttpConn *client) {
+    int done = DONE;
+    bool flushed = client->ToWriteBytes() == 0 || FlushConn(client, &done);
+    while (flushed && client->Process()) {
+        flushed = FlushConn(client, &done);
+    }
+    if (done == CLOSE) {
+        CloseConn(client);
+        return;
+    }
+    int fd = client->GetFd();
+    if (client->ToWriteBytes() > 0) {
+        poller_->ModFd(fd,
+                       EPOLLOUT | EPOLLONESHOT | (conn_event_ & EPOLLRDHUP),
+                       client->Gen());
+    }
+    if (client->ReadBytes() < HttpConn::READ_HIGH_WATER) {
+        poller_->Recv(fd, client->Gen());
+    }
+    client->Settle();
+}
@@ -0,0 +1,111 @@
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include "../http/httpconn.h"
+#include "../log/log.h"
+#include "../pool/mpscqueue.hpp"
+#include "../pool/threadpool.h"
+#include "../timer/timingwheel.h"
+#include "conntable.h"
+#include "poller.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <vector>
+
+// 事件循环：每个循环拥有自己的 Poller、时间轮和分配给它的连接
+// 连接对象存放在所有循环共享的 ConnTable 中，每个 fd 同一时刻只属于一个循环
+// conn_event 不含 EPOLLONESHOT 时使用连接归属模式：fd 以 EPOLLET 注册 IN|OUT
+// 后不再 ModFd，由循环记录连接的归属线程和尚未处理的事件
+// pool 为空时，读、解析、写都在循环所在线程内完成 (one loop per thread)
+// pool 不为空时，读写事件交给线程池处理 (单 Reactor + 线程池)，
+// 工作线程只处理连接本身，结果经完成队列和 eventfd 交回本循环，
+// Poller、时间轮和连接的关闭都只在循环线程中操作
+// 连接超时由时间轮管理，时间轮由注册在 Poller 中的 timerfd 驱动
+// Poller 支持完成式读取 (io_uring) 且没有线程池和 TLS 时，连接以 Recv 读取，
+// 数据随事件交付后拷入读缓冲区，只在有响应写不完时才监听可写
+class EventLoop {
+  public:
+    EventLoop(ConnTable *users, int time_out_MS, uint32_t conn_event,
+              ThreadPool *pool = nullptr, bool use_uring = false);
+    ~EventLoop();
+    void Loop();
+    // 可在任意线程调用
+    void Quit();
+    // 监听 fd 交给本循环，可读时调用 cb
+    // Poller 支持完成式 accept 时改为对每个接受的连接调用 on_accepted，
+    // 参数为新连接的 fd (已设为非阻塞)，出错时为 -errno
+    bool SetAcceptor(int listen_fd, uint32_t listen_event,
+                     const std::function<void()> &cb,
+                     const std::function<void(int)> &on_accepted = nullptr);
+    // 只能在本循环线程中调用
+    void AddClient(int fd, sockaddr_in addr);
+    // 可在任意线程调用，新连接经 eventfd 唤醒后由本循环加入
+    void QueueClient(int fd, sockaddr_in addr);
+    int ConnCount() const { return conn_count_; }
+    const char *PollerName() const { return poller_->Name(); }
+
+  private:
+    // 工作线程交回连接时的处理结果
+    enum DONE_STATE {
+        WANT_READ,  // 等待下一个请求 (EPOLLONESHOT)
+        WANT_WRITE, // 等待可写后继续写 (EPOLLONESHOT)
+        DONE,       // 本次事件处理完毕 (连接归属模式)
+        CLOSE,      // 关闭连接
+    };
+    void InitClient(int fd, sockaddr_in addr);
+    void HandleWakeup();
+    void HandleTimer();
+    void ArmTimer();
+    static void OnTimeout(void *loop, void *client);
+    void Wakeup();
+    void DealWrite(HttpConn *client);
+    void DealRead(HttpConn *client);
+    void ExtentTime(HttpConn *client);
+    void CloseConn(HttpConn *client);
+    void OnRead(HttpConn *client);
+    void OnWrite(HttpConn *client);
+    void OnProcess(HttpConn *client);
+    void DealEvent(HttpConn *client, uint32_t events);
+    void RunOwned(HttpConn *client, uint32_t events);
+    int OnEvent(HttpConn *client, uint32_t events);
+    bool FlushConn(HttpConn *client, int *done);
+    void OnRecv(HttpConn *client, const char *data, int len);
+    void Serve(HttpConn *client);
+    void Dispatch(HttpConn *client, const std::function<void()> &task);
+    void Complete(HttpConn *client, int done);
+    void HandleDone(HttpConn *client, int done);
+
+    ConnTable *users_;
+    int time_out_MS_;
+    uint32_t conn_event_;
+    bool owner_mode_;
+    // 以 Poller::Recv 读取连接
+    bool recv_mode_;
+    std::atomic<bool> quit_;
+    // 当前分配给本循环的连接数，用于最少连接分发
+    std::atomic<int> conn_count_;
+    int listen_fd_;
+    std::function<void()> accept_cb_;
+    std::function<void(int)> accepted_cb_;
+    // 其他线程投递新连接或交回连接时用来唤醒 epoll_wait
+    int wakeup_fd_;
+    std::mutex mtx_;
+    std::vector<std::pair<int, sockaddr_in>> pending_;
+    // 工作线程处理完成的连接
+    MpscQueue<HttpConn> done_;
+    ThreadPool *pool_;
+    std::unique_ptr<TimingWheel> timer_;
+    int timer_fd_;
+    // timerfd 当前设置的到期时间，-1 表示未设置
+    int64_t timer_armed_MS_;
+    std::unique_ptr<Poller> poller_;
+};
+
+#endif //__EVENTLOOP_H__
@@ -0,0 +1,16 @@
+#include "poller.h"
+#include "../log/log.h"
+#include "epoller.h"
+#include "uringpoller.h"
+
+Poller *Poller::NewPoller(bool use_uring, int max_event) {
+    if (use_uring) {
+        UringPoller *poller = new UringPoller(max_event);
+        if (poller->IsValid()) {
+            return poller;
+        }
+        delete poller;
+        LOG_WARN("io_uring unavailable, fall back to epoll!");
+    }
+    return new Epoller(max_event);
+}
@@ -0,0 +1,51 @@
+#ifndef __POLLER_H__
+#define __POLLER_H__
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// I/O 多路复用后端的统一接口，事件语义与 epoll 一致
+// (EPOLLIN/EPOLLOUT/EPOLLET/EPOLLONESHOT...)，EventLoop 只依赖这个接口
+// tag 随事件原样返回，用来识别 fd 被复用之后的过期事件
+// 后端还可以提供完成式的 accept 和读取 (io_uring)：内核直接完成操作，
+// 结果作为 EV_ACCEPT/EV_RECV 事件交付，不支持时相应的调用返回 false
+class Poller {
+  public:
+    // 事件的类型
+    enum EVENT_KIND {
+        EV_READY,  // 就绪事件，GetEvents 为 epoll 事件
+        EV_ACCEPT, // 监听 fd 上接受的新连接，GetEventResult 为它的 fd
+        EV_RECV,   // 读到的数据，GetEventResult 为字节数
+    };
+
+    virtual ~Poller() = default;
+    virtual bool AddFd(int fd, uint32_t events, uint32_t tag = 0) = 0;
+    virtual bool ModFd(int fd, uint32_t events, uint32_t tag = 0) = 0;
+    // 同时取消 fd 上的就绪监听和进行中的读取
+    virtual bool DelFd(int fd) = 0;
+    virtual int Wait(int time_out_MS = -1) = 0;
+    virtual int GetEventFd(size_t i) const = 0;
+    virtual uint32_t GetEventTag(size_t i) const = 0;
+    virtual uint32_t GetEvents(size_t i) const = 0;
+    virtual const char *Name() const = 0;
+
+    virtual int GetEventKind(size_t) const { return EV_READY; }
+    // EV_ACCEPT/EV_RECV 的结果，出错时为 -errno，EV_RECV 为 0 表示对端关闭
+    virtual int GetEventResult(size_t) const { return 0; }
+    // EV_RECV 读到的数据，在下一次 Wait 之前有效
+    virtual const char *GetEventData(size_t) const { return nullptr; }
+    // 是否支持 Recv；支持时也支持 AcceptMulti
+    virtual bool CanRecv() const { return false; }
+    // 在监听 fd 上持续接受连接，新连接已设为非阻塞，以 EV_ACCEPT 交付
+    virtual bool AcceptMulti(int) { return false; }
+    // 读取 fd 上的下一段数据，以 EV_RECV 交付，交付后需要再次调用；
+    // 已有读取在进行时什么也不做
+    virtual bool Recv(int, uint32_t) { return false; }
+    // 一次 Recv 最多读取的字节数，读满时 socket 中可能还有数据
+    virtual size_t RecvSize() const { return 0; }
+
+    // use_uring 为 true 时尝试使用 io_uring，内核不支持时退回 epoll
+    static Poller *NewPoller(bool use_uring, int max_event = 1024);
+};
+
+#endif //__POLLER_H__
@@ -0,0 +1,464 @@
+#include "uringpoller.h"
+
+UringPoller::UringPoller(int max_event)
+    : ring_fd_(-1), sqes_(static_cast<io_uring_sqe *>(MAP_FAILED)),
+      sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED), buf_ring_(nullptr),
+      buf_mem_(nullptr), buf_tail_(0), accept_fd_(-1), events_(max_event),
+      event_count_(0) {
+    assert(events_.size() > 0);
+    if (!InitRing(max_event)) {
+        if (ring_fd_ >= 0) {
+            close(ring_fd_);
+        }
+        ring_fd_ = -1;
+        return;
+    }
+    if (!InitBufRing()) {
+        LOG_WARN("io_uring buffer ring unavailable, use poll only!");
+    }
+}
+
+UringPoller::~UringPoller() {
+    if (buf_ring_) {
+        munmap(buf_ring_, BUF_COUNT * sizeof(io_uring_buf));
+        munmap(buf_mem_, BUF_COUNT * BUF_SIZE);
+    }
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqes_len_);
+    }
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) {
+        munmap(cq_ptr_, cq_len_);
+    }
+    if (sq_ptr_ != MAP_FAILED) {
+        munmap(sq_ptr_, sq_len_);
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+    }
+}
+
+bool UringPoller::InitRing(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd_ = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring_fd_ < 0) {
+        return false;
+    }
+    // 需要带超时的 io_uring_enter
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        return false;
+    }
+    sq_entries_ = p.sq_entries;
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    }
+    sq_ptr_ = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ = mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+    }
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(
+        mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+        return false;
+    }
+    char *sq = static_cast<char *>(sq_ptr_);
+    char *cq = static_cast<char *>(cq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    // sqe 与提交队列槽位一一对应
+    for (unsigned i = 0; i < sq_entries_; i++) {
+        sq_array_[i] = i;
+    }
+    return true;
+}
+
+// 缓冲区环和缓冲区都用匿名映射，页对齐
+bool UringPoller::InitBufRing() {
+    size_t ring_len = BUF_COUNT * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, ring_len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    void *mem = mmap(nullptr, BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        munmap(ring, ring_len);
+        return false;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+        munmap(ring, ring_len);
+        munmap(mem, BUF_COUNT * BUF_SIZE);
+        return false;
+    }
+    buf_ring_ = static_cast<io_uring_buf *>(ring);
+    buf_mem_ = static_cast<char *>(mem);
+    recycle_.reserve(BUF_COUNT);
+    for (unsigned i = 0; i < BUF_COUNT; i++) {
+        recycle_.push_back(i);
+    }
+    RecycleBufs();
+    return true;
+}
+
+void UringPoller::RecycleBufs() {
+    if (recycle_.empty()) {
+        return;
+    }
+    for (uint16_t bid : recycle_) {
+        io_uring_buf &buf = buf_ring_[buf_tail_ & (BUF_COUNT - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(buf_mem_ + bid * BUF_SIZE);
+        buf.len = BUF_SIZE;
+        buf.bid = bid;
+        buf_tail_++;
+    }
+    recycle_.clear();
+    // 内核看到新的 tail 之后才会使用这些缓冲区
+    __atomic_store_n(&buf_ring_[0].resv, buf_tail_, __ATOMIC_RELEASE);
+}
+
+int UringPoller::Enter(unsigned to_submit, unsigned min_complete,
+                       unsigned flags, void *arg, size_t arg_size) {
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                   flags, arg, arg_size);
+}
+
+unsigned UringPoller::Unsubmitted() const {
+    return *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+}
+
+// 调用前需要持有 mtx_
+io_uring_sqe *UringPoller::GetSqe() {
+    while (Unsubmitted() >= sq_entries_) {
+        Flush();
+    }
+    io_uring_sqe *sqe = &sqes_[*sq_tail_ & *sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void UringPoller::CommitSqe() {
+    __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+}
+
+void UringPoller::Flush() {
+    unsigned n = Unsubmitted();
+    if (n > 0) {
+        Enter(n, 0, 0, nullptr, 0);
+    }
+}
+
+UringPoller::FdState &UringPoller::State(int fd) {
+    if (static_cast<size_t>(fd) >= fds_.size()) {
+        fds_.resize(fd + 1, FdState{0, 0, 0, false, false, 0});
+    }
+    return fds_[fd];
+}
+
+void UringPoller::PrepPoll(int fd) {
+    FdState &st = State(fd);
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    // EPOLLIN/EPOLLOUT/EPOLLRDHUP... 与 poll 的取值相同
+    sqe->poll32_events = st.events & ~(EPOLLET | EPOLLONESHOT);
+    if ((st.events & EPOLLET) && !(st.events & EPOLLONESHOT)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = UserData(OP_POLL, st.gen, fd);
+    CommitSqe();
+    st.armed = true;
+}
+
+void UringPoller::PrepRemove(int fd) {
+    FdState &st = State(fd);
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = UserData(OP_POLL, st.gen, fd);
+    sqe->user_data = IGNORE_DATA;
+    CommitSqe();
+    st.armed = false;
+}
+
+// 最多读一块，数据放在内核从环中选出的缓冲区里
+void UringPoller::PrepRecv(int fd) {
+    FdState &st = State(fd);
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = UserData(OP_RECV, st.recv_gen, fd);
+    CommitSqe();
+    st.recv_armed = true;
+}
+
+// 不取对端地址：多个连接的完成事件会写同一个地址
+void UringPoller::PrepAccept() {
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = accept_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = UserData(OP_ACCEPT, 0, accept_fd_);
+    CommitSqe();
+}
+
+void UringPoller::PrepCancel(uint64_t user_data) {
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = IGNORE_DATA;
+    CommitSqe();
+}
+
+bool UringPoller::AddFd(int fd, uint32_t events, uint32_t tag) {
+    if (fd < 0)
+        return false;
+    std::lock_guard<std::mutex> lock(mtx_);
+    FdState &st = State(fd);
+    if (st.armed) {
+        PrepRemove(fd);
+    }
+    st.gen++;
+    st.events = events;
+    st.tag = tag;
+    PrepPoll(fd);
+    if (std::this_thread::get_id() != owner_.load(std::memory_order_relaxed)) {
+        Flush();
+    }
+    return true;
+}
+
+bool UringPoller::ModFd(int fd, uint32_t events, uint32_t tag) {
+    if (fd < 0)
+        return false;
+    std::lock_guard<std::mutex> lock(mtx_);
+    FdState &st = State(fd);
+    if (st.armed) {
+        PrepRemove(fd);
+    }
+    st.gen++;
+    st.events = events;
+    st.tag = tag;
+    PrepPoll(fd);
+    if (std::this_thread::get_id() != owner_.load(std::memory_order_relaxed)) {
+        Flush();
+    }
+    return true;
+}
+
+bool UringPoller::DelFd(int fd) {
+    if (fd < 0)
+        return false;
+    std::lock_guard<std::mutex> lock(mtx_);
+    FdState &st = State(fd);
+    if (st.armed) {
+        PrepRemove(fd);
+    }
+    st.gen++;
+    st.events = 0;
+    if (st.recv_armed) {
+        PrepCancel(UserData(OP_RECV, st.recv_gen, fd));
+        st.recv_armed = false;
+    }
+    st.recv_gen++;
+    // poll 和 recv 请求持有文件引用，立即提交以免 close 之后连接迟迟不释放
+    Flush();
+    return true;
+}
+
+bool UringPoller::AcceptMulti(int listen_fd) {
+    if (listen_fd < 0 || !buf_ring_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    accept_fd_ = listen_fd;
+    PrepAccept();
+    if (std::this_thread::get_id() != owner_.load(std::memory_order_relaxed)) {
+        Flush();
+    }
+    return true;
+}
+
+bool UringPoller::Recv(int fd, uint32_t tag) {
+    if (fd < 0 || !buf_ring_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    FdState &st = State(fd);
+    st.tag = tag;
+    if (!st.recv_armed) {
+        PrepRecv(fd);
+    }
+    if (std::this_thread::get_id() != owner_.load(std::memory_order_relaxed)) {
+        Flush();
+    }
+    return true;
+}
+
+int UringPoller::Wait(int time_out_MS) {
+    std::thread::id self = std::this_thread::get_id();
+    if (owner_.load(std::memory_order_relaxed) != self) {
+        owner_.store(self, std::memory_order_relaxed);
+    }
+    unsigned to_submit;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        // 上一轮交付的数据已经处理完
+        if (buf_ring_) {
+            RecycleBufs();
+        }
+        to_submit = Unsubmitted();
+    }
+    // 完成队列中还有上次未取完的事件时不阻塞
+    bool ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+    if (time_out_MS != 0 && !ready) {
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (time_out_MS > 0) {
+            ts.tv_sec = time_out_MS / 1000;
+            ts.tv_nsec = (time_out_MS % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        Enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+              &arg, sizeof(arg));
+    } else if (to_submit > 0) {
+        Enter(to_submit, 0, 0, nullptr, 0);
+    }
+    Reap();
+    return static_cast<int>(event_count_);
+}
+
+void UringPoller::Reap() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    event_count_ = 0;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail && event_count_ < events_.size(); head++) {
+        const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+        if (cqe.user_data == IGNORE_DATA) {
+            continue;
+        }
+        uint32_t low = static_cast<uint32_t>(cqe.user_data);
+        int op = static_cast<int>(low >> OP_SHIFT);
+        int fd = static_cast<int>(low & FD_MASK);
+        uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32);
+        if (op != OP_POLL) {
+            ReapCompletion(cqe, op, fd);
+            continue;
+        }
+        if (static_cast<size_t>(fd) >= fds_.size() || fds_[fd].gen != gen) {
+            // 已被 ModFd/DelFd 取代的请求
+            continue;
+        }
+        FdState &st = fds_[fd];
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            st.armed = false;
+        }
+        if (cqe.res == -ECANCELED) {
+            continue;
+        }
+        uint32_t events =
+            cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res);
+        events_[event_count_++] =
+            Event{EV_READY, fd, st.tag, events, 0, nullptr};
+        // 非 EPOLLONESHOT 的 fd 保持监听，在下次 Wait 时一起提交
+        if (!st.armed && st.events && !(st.events & EPOLLONESHOT)) {
+            PrepPoll(fd);
+        }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+// 调用前需要持有 mtx_
+void UringPoller::ReapCompletion(const io_uring_cqe &cqe, int op, int fd) {
+    const char *data = nullptr;
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        // 过期的完成事件也占用了缓冲区，同样在下一次 Wait 时归还
+        uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        recycle_.push_back(bid);
+        data = buf_mem_ + bid * BUF_SIZE;
+    }
+    if (op == OP_ACCEPT) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            // multishot accept 因出错等原因结束，重新提交
+            PrepAccept();
+        }
+        events_[event_count_++] = Event{EV_ACCEPT, fd, 0, 0, cqe.res, nullptr};
+        return;
+    }
+    uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32);
+    if (static_cast<size_t>(fd) >= fds_.size() || fds_[fd].recv_gen != gen) {
+        // 已被 DelFd 取消的读取
+        return;
+    }
+    FdState &st = fds_[fd];
+    st.recv_armed = false;
+    if (cqe.res == -ENOBUFS) {
+        // 缓冲区暂时用完，归还之后的下一次 Wait 中继续读
+        PrepRecv(fd);
+        return;
+    }
+    events_[event_count_++] = Event{EV_RECV, fd, st.tag, 0, cqe.res, data};
+}
+
+int UringPoller::GetEventFd(size_t i) const {
+    assert(i < event_count_);
+    return events_[i].fd;
+}
+
+uint32_t UringPoller::GetEventTag(size_t i) const {
+    assert(i < event_count_);
+    return events_[i].tag;
+}
+
+uint32_t UringPoller::GetEvents(size_t i) const {
+    assert(i < event_count_);
+    return events_[i].events;
+}
+
+int UringPoller::GetEventKind(size_t i) const {
+    assert(i < event_count_);
+    return events_[i].kind;
+}
+
+int UringPoller::GetEventResult(size_t i) const {
+    assert(i < event_count_);
+    return events_[i].result;
+}
+
+const char *UringPoller::GetEventData(size_t i) const {
+    assert(i < event_count_);
+    return events_[i].data;
+}
@@ -0,0 +1,146 @@
+#ifndef __URINGPOLLER_H__
+#define __URINGPOLLER_H__
+
+#include "../log/log.h"
+#include "poller.h"
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 基于 io_uring 的 Poller，用 POLL_ADD 请求模拟 epoll 的就绪语义
+// 循环线程内的 AddFd/ModFd 只写入提交队列，在下一次 Wait 时与等待一起批量提交
+// (一次 io_uring_enter)；其他线程调用时立即提交，保证工作线程的改动不被延迟
+// EPOLLET 且非 EPOLLONESHOT 使用 multishot poll，
+// 水平触发的 fd 在事件交付后自动重新提交
+// 内核支持缓冲区环 (5.19+) 时还提供完成式 I/O：
+// AcceptMulti 提交 multishot accept，每个新连接一个完成事件，不再调用 accept；
+// Recv 提交带 IOSQE_BUFFER_SELECT 的 recv，数据到达时内核从注册的缓冲区环
+// 中取一块读入，交付后这块在下一次 Wait 时归还环中
+// 这些请求同样在 Wait 时批量提交，读取和等待合并在一次 io_uring_enter 中
+class UringPoller : public Poller {
+  public:
+    explicit UringPoller(int max_event = 1024);
+    ~UringPoller() override;
+    bool IsValid() const { return ring_fd_ >= 0; }
+    bool AddFd(int fd, uint32_t events, uint32_t tag = 0) override;
+    bool ModFd(int fd, uint32_t events, uint32_t tag = 0) override;
+    bool DelFd(int fd) override;
+    int Wait(int time_out_MS = -1) override;
+    int GetEventFd(size_t i) const override;
+    uint32_t GetEventTag(size_t i) const override;
+    uint32_t GetEvents(size_t i) const override;
+    const char *Name() const override { return "io_uring"; }
+    int GetEventKind(size_t i) const override;
+    int GetEventResult(size_t i) const override;
+    const char *GetEventData(size_t i) const override;
+    bool CanRecv() const override { return buf_ring_ != nullptr; }
+    size_t RecvSize() const override { return BUF_SIZE; }
+    bool AcceptMulti(int listen_fd) override;
+    bool Recv(int fd, uint32_t tag) override;
+
+  private:
+    // 缓冲区环的块数 (2 的幂) 和每块的大小
+    static const unsigned BUF_COUNT = 256;
+    static const unsigned BUF_SIZE = 4096;
+    static const uint16_t BUF_GROUP = 0;
+
+    // user_data 的低 32 位：请求的类型和 fd，高 32 位为 gen
+    enum OP {
+        OP_POLL,
+        OP_RECV,
+        OP_ACCEPT,
+    };
+    static const int OP_SHIFT = 30;
+    static const uint32_t FD_MASK = (1u << OP_SHIFT) - 1;
+    static uint64_t UserData(int op, uint32_t gen, int fd) {
+        return (static_cast<uint64_t>(gen) << 32) |
+               (static_cast<uint32_t>(op) << OP_SHIFT) |
+               static_cast<uint32_t>(fd);
+    }
+
+    struct FdState {
+        uint32_t gen;    // 每次重新提交都会递增，用来丢弃过期的完成事件
+        uint32_t events; // 调用方设置的 epoll 事件
+        uint32_t tag;    // 调用方设置的 tag
+        bool armed;      // 是否有 poll 请求在内核中
+        bool recv_armed; // 是否有 recv 请求在内核中
+        uint32_t recv_gen; // 同 gen，用于 recv 请求，DelFd 时递增
+    };
+    struct Event {
+        int kind;
+        int fd;
+        uint32_t tag;
+        uint32_t events;
+        int result;
+        const char *data;
+    };
+    bool InitRing(unsigned entries);
+    bool InitBufRing();
+    // 把上一轮交付的缓冲区归还环中
+    void RecycleBufs();
+    io_uring_sqe *GetSqe();
+    void CommitSqe();
+    void PrepPoll(int fd);
+    void PrepRemove(int fd);
+    void PrepRecv(int fd);
+    void PrepAccept();
+    void PrepCancel(uint64_t user_data);
+    // 就绪以外的完成事件，已在 Reap 中处理缓冲区
+    void ReapCompletion(const io_uring_cqe &cqe, int op, int fd);
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+              void *arg, size_t arg_size);
+    void Flush();
+    void Reap();
+    unsigned Unsubmitted() const;
+    FdState &State(int fd);
+
+    static const uint64_t IGNORE_DATA = ~0ULL;
+
+    int ring_fd_;
+    unsigned sq_entries_;
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned *sq_mask_;
+    unsigned *sq_array_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned *cq_mask_;
+    io_uring_sqe *sqes_;
+    io_uring_cqe *cqes_;
+    void *sq_ptr_;
+    void *cq_ptr_;
+    size_t sq_len_;
+    size_t cq_len_;
+    size_t sqes_len_;
+
+    // 缓冲区环，注册失败时为空，不支持完成式 I/O
+    // 按 io_uring_buf 数组访问：io_uring_buf_ring 的柔性数组在 C++ 中
+    // 偏移不为 0；环的 tail 与第一项的 resv 重叠
+    io_uring_buf *buf_ring_;
+    char *buf_mem_;
+    uint16_t buf_tail_;
+    // 上一轮交付的事件占用的缓冲区
+    std::vector<uint16_t> recycle_;
+    int accept_fd_;
+
+    // 提交队列和 fds_ 可能被工作线程访问
+    std::mutex mtx_;
+    // 调用 Wait 的线程，只有它的提交会被延迟到 Wait 时批量进行
+    // 由循环线程写、工作线程读，只需判断是否为自己，relaxed 即可
+    std::atomic<std::thread::id> owner_;
+    std::vector<FdState> fds_;
+    std::vector<Event> events_;
+    size_t event_count_;
+};
+
+#endif //__URINGPOLLER_H__
@@ -3,19 +3,45 @@
 WebServer::WebServer(int port, int trig_mode, int time_out_MS, bool opt_linger,
                      int sql_port, const char *sql_user, const char *sql_pwd,
                      const char *db_name, int conn_pool_num, int thread_num,
-                     bool open_log, int log_level, int log_queue_size)
+                     bool open_log, int log_level, int log_queue_size,
+                     int loop_num, bool least_conn, bool use_uring,
+                     bool one_shot, int file_cache_MB, int file_check_MS,
+                     const char *tls_cert, const char *tls_key)
     : port_(port), open_linger_(opt_linger), time_out_MS_(time_out_MS),
-      is_close_(false), timer_(new HeapTimer()),
-      thread_pool_(new ThreadPool(thread_num)), epoller_(new Epoller()) {
+      is_close_(false), least_conn_(least_conn), next_loop_(0),
+      users_(new ConnTable(max_fd_)) {
     src_dir_ = getcwd(nullptr, 256);
     assert(src_dir_);
     strncat(src_dir_, "/resources", 16);
     HttpConn::user_count_ = 0;
     HttpConn::src_dir_ = src_dir_;
+    FileCache::Instance()->Init(static_cast<size_t>(file_cache_MB) << 20,
+                                file_check_MS);
+    HttpResponse::LoadErrorPages(src_dir_);
+    // 对端关闭后的写入 (包括 OpenSSL 发送的 close_notify) 返回 EPIPE，
+    // 不能让 SIGPIPE 终止进程
+    signal(SIGPIPE, SIG_IGN);
+    bool tls_ok = true;
+    if (tls_cert && tls_key) {
+        tls_ok = TlsContext::Instance()->Init(tls_cert, tls_key);
+    }
     SqlConnPool::Instance()->Init("localhost", sql_port, sql_user, sql_pwd,
                                   db_name, conn_pool_num);
-    InitEventMode(trig_mode);
-    if (!InitSocket()) {
+    InitEventMode(trig_mode, one_shot);
+    if (loop_num > 0) {
+        // 多 Reactor：连接的读、解析、写都在所属子循环内完成，不再使用线程池
+        main_loop_.reset(
+            new EventLoop(users_.get(), -1, conn_event_, nullptr, use_uring));
+        for (int i = 0; i < loop_num; i++) {
+            sub_loops_.emplace_back(new EventLoop(
+                users_.get(), time_out_MS_, conn_event_, nullptr, use_uring));
+        }
+    } else {
+        thread_pool_.reset(new ThreadPool(thread_num));
+        main_loop_.reset(new EventLoop(users_.get(), time_out_MS_, conn_event_,
+                                       thread_pool_.get(), use_uring));
+    }
+    if (!tls_ok || !InitSocket()) {
         is_close_ = true;
     }
     if (open_log) {
@@ -28,25 +54,40 @@ WebServer::WebServer(int port, int trig_mode, int time_out_MS, bool opt_linger,
             LOG_INFO("========== Server init ==========");
             LOG_INFO("Port:%d, OpenLinger: %s", port_,
                      opt_linger ? "true" : "false");
-            LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
+            LOG_INFO("Listen Mode: %s, OpenConn Mode: %s, OneShot: %s",
                      (listen_event_ & EPOLLET ? "ET" : "LT"),
-                     (conn_event_ & EPOLLET ? "ET" : "LT"));
+                     (conn_event_ & EPOLLET ? "ET" : "LT"),
+                     (conn_event_ & EPOLLONESHOT ? "true" : "false"));
             LOG_INFO("LogSys level: %d", log_level);
             LOG_INFO("srcDir: %s", HttpConn::src_dir_);
             LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", conn_pool_num,
                      thread_num);
+            LOG_INFO("EventLoop num: %d, Dispatch: %s, Poller: %s", loop_num,
+                     least_conn ? "least-conn" : "round-robin",
+                     main_loop_->PollerName());
+            LOG_INFO("Scan impl: %s", Scan::Name());
+            LOG_INFO("FileCache: %dMB, check interval: %dms", file_cache_MB,
+                     file_check_MS);
+            LOG_INFO("TLS: %s", TlsContext::Instance()->Enabled() ? tls_cert
+                                                                  : "off");
         }
     }
 }
 
 WebServer::~WebServer() {
+    for (auto &loop : sub_loops_) {
+        loop->Quit();
+    }
+    for (auto &t : loop_threads_) {
+        t.join();
+    }
     close(listen_fd_);
     is_close_ = true;
     free(src_dir_);
     SqlConnPool::Instance()->ClosePool();
 }
 
-void WebServer::InitEventMode(int trig_mode) {
+void WebServer::InitEventMode(int trig_mode, bool one_shot) {
     listen_event_ = EPOLLRDHUP;
     conn_event_ = EPOLLONESHOT | EPOLLRDHUP;
     switch (trig_mode) {
@@ -67,68 +108,49 @@ void WebServer::InitEventMode(int trig_mode) {
         conn_event_ |= EPOLLET;
         break;
     }
+    if (!one_shot) {
+        // 连接归属模式：连接 fd 必须是边沿触发，注册后不再 ModFd
+        conn_event_ = EPOLLRDHUP | EPOLLET;
+    }
     HttpConn::is_ET_ = (conn_event_ & EPOLLET);
 }
 
 void WebServer::Start() {
-    int timeMS = -1; /* epoll wait timeout == -1 无事件将阻塞 */
     if (!is_close_) {
         LOG_INFO("========== Server start ==========");
-    }
-    while (!is_close_) {
-        if (time_out_MS_ > 0) {
-            // timeMS 之后会有时钟到期
-            timeMS = timer_->GetNextTick();
-        }
-        int event_count = epoller_->Wait(timeMS);
-        for (int i = 0; i < event_count; i++) {
-            // 处理事件
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
-            if (fd == listen_fd_) {
-                DealListen();
-            } else if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn(&users_[fd]);
-            } else if (events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead(&users_[fd]);
-            } else if (events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite(&users_[fd]);
-            } else {
-                LOG_ERROR("Unexpected event");
-            }
+        for (auto &loop : sub_loops_) {
+            loop_threads_.emplace_back(&EventLoop::Loop, loop.get());
         }
+        main_loop_->Loop();
     }
 }
 
-void WebServer::SendError(int fd, const char *info) {
-    assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
-    if (ret < 0) {
-        LOG_WARN("send error to client[%d] error!", fd);
-    }
-    close(fd);
+int64_t WebServer::QueueDelayUS() {
+    return thread_pool_ ? thread_pool_->QueueDelayUS() : 0;
 }
 
-void WebServer::CloseConn(HttpConn *client) {
-    assert(client);
-    LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
-    client->Close();
+void WebServer::LogConnStats() {
+    std::string stats;
+    char item[64];
+    for (int i = 0; i < HttpConn::STATE_COUNT; i++) {
+        snprintf(item, sizeof(item), "%s%s:%d/%zuB", i ? ", " : "",
+                 HttpConn::StateName(i), HttpConn::StateConns(i),
+                 HttpConn::StateBytes(i));
+        stats += item;
+    }
+    LOG_INFO("Conn buffers: %s", stats.c_str());
 }
 
-void WebServer::AddClient(int fd, sockaddr_in addr) {
+// TLS 连接还没有握手，无法发送明文响应，直接关闭
+void WebServer::SendError(int fd, const char *info) {
     assert(fd > 0);
-    users_[fd].Init(fd, addr);
-    if (time_out_MS_ > 0) {
-        timer_->add(fd, time_out_MS_,
-                    std::bind(&WebServer::CloseConn, this, &users_[fd]));
+    if (!TlsContext::Instance()->Enabled()) {
+        int ret = send(fd, info, strlen(info), 0);
+        if (ret < 0) {
+            LOG_WARN("send error to client[%d] error!", fd);
+        }
     }
-    epoller_->AddFd(fd, EPOLLIN | conn_event_);
-    SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    close(fd);
 }
 
 void WebServer::DealListen() {
@@ -138,77 +160,67 @@ void WebServer::DealListen() {
         int fd = accept(listen_fd_, (struct sockaddr *)&addr, &len);
         if (fd <= 0) {
             return;
-        } else if (HttpConn::user_count_ >= max_fd_) {
+        } else if (HttpConn::user_count_ >= max_fd_ || fd >= max_fd_) {
             SendError(fd, "Server busy!");
             LOG_WARN("Clients is full!");
             return;
         }
-        AddClient(fd, addr);
+        SetFdNonblock(fd);
+        NewClient(fd, addr);
     } while (listen_event_ & EPOLLET);
 }
 
-void WebServer::DealRead(HttpConn *client) {
-    assert(client);
-    ExtentTime(client);
-    thread_pool_->AddTask(std::bind(&WebServer::OnRead, this, client));
-}
-
-void WebServer::DealWrite(HttpConn *client) {
-    assert(client);
-    ExtentTime(client);
-    thread_pool_->AddTask(std::bind(&WebServer::OnWrite, this, client));
-}
-
-void WebServer::ExtentTime(HttpConn *client) {
-    assert(client);
-    if (time_out_MS_ > 0) {
-        timer_->adjust(client->GetFd(), time_out_MS_);
+// 由 Poller 完成 accept 的新连接，已设为非阻塞
+void WebServer::DealAccepted(int fd) {
+    if (fd < 0) {
+        LOG_WARN("Accept error: %s", strerror(-fd));
+        return;
     }
-}
-
-// 在一个新的线程中执行
-void WebServer::OnRead(HttpConn *client) {
-    assert(client);
-    int ret = -1;
-    int readErrno = 0;
-    ret = client->Read(&readErrno);
-    if (ret <= 0 && readErrno != EAGAIN) {
-        CloseConn(client);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    if (Log::Instance()->IsOpen()) {
+        // 对端地址只用于日志
+        socklen_t len = sizeof(addr);
+        getpeername(fd, (struct sockaddr *)&addr, &len);
+    }
+    if (HttpConn::user_count_ >= max_fd_ || fd >= max_fd_) {
+        SendError(fd, "Server busy!");
+        LOG_WARN("Clients is full!");
         return;
     }
-    OnProcess(client);
+    NewClient(fd, addr);
 }
 
-void WebServer::OnProcess(HttpConn *client) {
-    if (client->Process()) {
-        epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
+void WebServer::NewClient(int fd, const sockaddr_in &addr) {
+    if (thread_pool_ && thread_pool_->IsOverloaded()) {
+        // 排队时延持续过高，尽早拒绝新连接，优先完成已接收的请求
+        SendError(fd, BUSY_RESPONSE);
+        LOG_WARN("ThreadPool overloaded, queue delay:%ldus, shed client!",
+                 thread_pool_->QueueDelayUS());
+        return;
+    }
+    if (sub_loops_.empty()) {
+        main_loop_->AddClient(fd, addr);
     } else {
-        epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN);
+        NextLoop()->QueueClient(fd, addr);
     }
 }
 
-// 在一个新的线程中执行,
-// iov 已经准备好
-// 这里只需要执行 client->write, write_buff_中的内容写入到 fd 中即可
-void WebServer::OnWrite(HttpConn *client) {
-    assert(client);
-    int ret = -1;
-    int writeErrno = 0;
-    ret = client->Write(&writeErrno);
-    if (client->ToWriteBytes() == 0) {
-        /* 传输完成 */
-        if (client->IsKeepAlive()) {
-            OnProcess(client);
-            return;
-        }
-    } else if (ret < 0) {
-        if (writeErrno == EAGAIN) {
-            /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
-            return;
+// 轮询或选择连接数最少的子循环
+EventLoop *WebServer::NextLoop() {
+    assert(!sub_loops_.empty());
+    if (!least_conn_) {
+        EventLoop *loop = sub_loops_[next_loop_].get();
+        next_loop_ = (next_loop_ + 1) % sub_loops_.size();
+        return loop;
+    }
+    EventLoop *loop = sub_loops_[0].get();
+    for (auto &item : sub_loops_) {
+        if (item->ConnCount() < loop->ConnCount()) {
+            loop = item.get();
         }
     }
-    CloseConn(client);
+    return loop;
 }
 
 // Create listenFd
@@ -267,7 +279,10 @@ bool WebServer::InitSocket() {
         close(listen_fd_);
         return false;
     }
-    ret = epoller_->AddFd(listen_fd_, listen_event_ | EPOLLIN);
+    ret = main_loop_->SetAcceptor(
+        listen_fd_, listen_event_ | EPOLLIN,
+        std::bind(&WebServer::DealListen, this),
+        std::bind(&WebServer::DealAccepted, this, std::placeholders::_1));
     if (ret == 0) {
         LOG_ERROR("Add listen error!");
         close(listen_fd_);
@@ -5,40 +5,48 @@
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
 #include "../pool/threadpool.h"
-#include "../timer/heaptimer.h"
-#include "epoller.h"
+#include "eventloop.h"
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <thread>
 #include <unistd.h>
-#include <unordered_map>
+#include <vector>
 
 class WebServer {
   public:
     WebServer(int port, int trig_mode, int time_out_MS, bool opt_linger,
               int sql_port, const char *sql_user, const char *sql_pwd,
               const char *db_name, int conn_pool_num, int thread_num,
-              bool open_log, int log_level, int log_queue_size);
+              bool open_log, int log_level, int log_queue_size,
+              int loop_num = 0, bool least_conn = false,
+              bool use_uring = false, bool one_shot = true,
+              int file_cache_MB = 64, int file_check_MS = 1000,
+              const char *tls_cert = nullptr, const char *tls_key = nullptr);
     ~WebServer();
     void Start();
+    // 线程池任务的排队时延 (微秒)，多 Reactor 模式下为 0
+    int64_t QueueDelayUS();
+    // 在日志中记录各状态的连接数和它们持有的缓冲区字节数，可在任意线程调用
+    void LogConnStats();
 
   private:
     bool InitSocket();
-    void InitEventMode(int trig_mode);
-    void AddClient(int fd, sockaddr_in addr);
+    void InitEventMode(int trig_mode, bool one_shot);
     void DealListen();
-    void DealWrite(HttpConn *client);
-    void DealRead(HttpConn *client);
+    void DealAccepted(int fd);
+    // 检查负载后把新连接交给一个循环
+    void NewClient(int fd, const sockaddr_in &addr);
+    EventLoop *NextLoop();
     void SendError(int fd, const char *info);
-    void ExtentTime(HttpConn *client);
-    void CloseConn(HttpConn *client);
-    void OnRead(HttpConn *client);
-    void OnWrite(HttpConn *client);
-    void OnProcess(HttpConn *client);
     static const int max_fd_ = 65536;
+    static constexpr const char *BUSY_RESPONSE =
+        "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\n"
+        "Connection: close\r\nContent-length: 0\r\n\r\n";
     static int SetFdNonblock(int fd);
     int port_;
     bool open_linger_;
@@ -48,10 +56,17 @@ class WebServer {
     char *src_dir_;
     uint32_t listen_event_;
     uint32_t conn_event_;
-    std::unique_ptr<HeapTimer> timer_;
+    // 为 true 时新连接交给连接数最少的子循环，否则轮询
+    bool least_conn_;
+    size_t next_loop_;
     std::unique_ptr<ThreadPool> thread_pool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
+    // 以 fd 为下标的连接表，所有循环共享，需在循环之前构造、之后析构
+    std::unique_ptr<ConnTable> users_;
+    // 主循环：负责 listen_fd_，没有子循环时也负责全部连接
+    std::unique_ptr<EventLoop> main_loop_;
+    // 子循环：每个运行在自己的线程中，处理分配给它的连接
+    std::vector<std::unique_ptr<EventLoop>> sub_loops_;
+    std::vector<std::thread> loop_threads_;
 };
 
 #endif //__WEBSERVER_H__
\ No newline at end of file
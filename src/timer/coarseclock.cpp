@@ -0,0 +1,49 @@
+#include "coarseclock.h"
+
+thread_local CoarseClock::State CoarseClock::state_;
+
+void CoarseClock::Update() {
+    state_.driven = true;
+    state_.mono_MS = ReadMonoMS();
+    RefreshWall(state_);
+}
+
+int64_t CoarseClock::NowMS() {
+    if (!state_.driven) {
+        return ReadMonoMS();
+    }
+    return state_.mono_MS;
+}
+
+const CoarseClock::WallTime &CoarseClock::Wall() {
+    if (!state_.driven) {
+        RefreshWall(state_);
+    }
+    return state_.wall;
+}
+
+int64_t CoarseClock::ReadMonoMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void CoarseClock::RefreshWall(State &state) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    WallTime &wall = state.wall;
+    wall.usec = ts.tv_nsec / 1000;
+    if (ts.tv_sec == state.formatted_sec) {
+        return;
+    }
+    // 跨秒时才做 localtime 和格式化
+    state.formatted_sec = ts.tv_sec;
+    localtime_r(&ts.tv_sec, &wall.local);
+    strftime(wall.log_time, sizeof(wall.log_time), "%Y-%m-%d %H:%M:%S",
+             &wall.local);
+    // HTTP Date 使用 GMT；程序没有调用 setlocale，%a/%b 为英文缩写
+    struct tm g;
+    gmtime_r(&ts.tv_sec, &g);
+    strftime(wall.http_date, sizeof(wall.http_date),
+             "%a, %d %b %Y %H:%M:%S GMT", &g);
+}
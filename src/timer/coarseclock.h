@@ -0,0 +1,40 @@
+#ifndef __COARSECLOCK_H__
+#define __COARSECLOCK_H__
+
+#include <stdint.h>
+#include <time.h>
+
+// 线程本地的粗粒度时钟
+// 事件循环每轮调用一次 Update，之后本轮内的读取都不再有系统调用；
+// 没有调用过 Update 的线程 (例如工作线程) 在每次读取时惰性刷新，
+// 只读 *_COARSE 时钟，格式化的时间字符串每秒才重新生成一次
+class CoarseClock {
+  public:
+    // 墙上时间，字符串部分精确到秒
+    struct WallTime {
+        struct tm local;    // 本地时间
+        long usec;          // 微秒部分
+        char log_time[20];  // "2024-01-01 12:00:00"
+        char http_date[30]; // "Mon, 01 Jan 2024 04:00:00 GMT"
+    };
+
+    // 刷新当前线程的缓存时间，之后只在下一次 Update 时更新
+    static void Update();
+    // 单调时钟 ms，用于超时
+    static int64_t NowMS();
+    static const WallTime &Wall();
+
+  private:
+    struct State {
+        bool driven = false; // 由事件循环调用 Update 刷新
+        int64_t mono_MS = 0;
+        time_t formatted_sec = -1;
+        WallTime wall;
+    };
+    static int64_t ReadMonoMS();
+    static void RefreshWall(State &state);
+
+    static thread_local State state_;
+};
+
+#endif //__COARSECLOCK_H__
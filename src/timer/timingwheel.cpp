@@ -0,0 +1,219 @@
+#include "timingwheel.h"
+
+TimingWheel::TimingWheel(int tick_MS)
+    : tick_MS_(tick_MS > 0 ? tick_MS : 1), count_(0), bitmap_{0} {
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        slots_[i].prev = slots_[i].next = &slots_[i];
+        slots_[i].slot = i;
+    }
+    cur_tick_ = CoarseClock::NowMS() / tick_MS_;
+}
+
+TimingWheel::~TimingWheel() {
+    // 节点由使用者持有，这里只把它们摘下
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        TimerNode *head = &slots_[i];
+        while (!Empty(head)) {
+            TimerNode *node = head->next;
+            head->next = node->next;
+            node->prev = node->next = nullptr;
+            node->slot = -1;
+        }
+    }
+}
+
+void TimingWheel::Link(TimerNode *node, int slot) {
+    TimerNode *head = &slots_[slot];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    node->slot = slot;
+    if (slot < L0_SIZE) {
+        bitmap_[slot >> 6] |= 1ULL << (slot & 63);
+    }
+}
+
+void TimingWheel::Unlink(TimerNode *node) {
+    assert(node->IsActive());
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    int slot = node->slot;
+    if (slot < L0_SIZE && Empty(&slots_[slot])) {
+        bitmap_[slot >> 6] &= ~(1ULL << (slot & 63));
+    }
+    node->prev = node->next = nullptr;
+    node->slot = -1;
+}
+
+// 按到期时间放入对应层的槽中，到期的 tick 向上取整，保证不会提前触发
+void TimingWheel::Insert(TimerNode *node) {
+    int64_t expire = (node->expires + tick_MS_ - 1) / tick_MS_;
+    int64_t delta = expire - cur_tick_;
+    if (delta < L0_SIZE) {
+        if (delta < 0) {
+            expire = cur_tick_;
+        }
+        Link(node, expire & L0_MASK);
+        return;
+    }
+    if (delta >= MAX_TICKS) {
+        // 超出时间轮范围，先放在最远处，到时再重新放置
+        expire = cur_tick_ + MAX_TICKS - 1;
+        delta = MAX_TICKS - 1;
+    }
+    int level = 1;
+    while (delta >= (1LL << (L0_BITS + level * LN_BITS))) {
+        level++;
+    }
+    int shift = L0_BITS + (level - 1) * LN_BITS;
+    int index = (expire >> shift) & LN_MASK;
+    Link(node, L0_SIZE + (level - 1) * LN_SIZE + index);
+}
+
+void TimingWheel::Add(TimerNode *node, int time_out_MS, TimeoutCallBack cb,
+                      void *arg, void *data) {
+    assert(node && cb);
+    node->cb = cb;
+    node->arg = arg;
+    node->data = data;
+    Adjust(node, time_out_MS);
+}
+
+void TimingWheel::Adjust(TimerNode *node, int time_out_MS) {
+    assert(node);
+    int64_t now = CoarseClock::NowMS();
+    int64_t expires = now + time_out_MS;
+    if (!node->IsActive()) {
+        if (count_ == 0 && cur_tick_ < now / tick_MS_) {
+            // 空闲期间没有 Tick，先追上当前时间
+            cur_tick_ = now / tick_MS_;
+        }
+        node->expires = expires;
+        Insert(node);
+        count_++;
+    } else if (expires >= node->expires) {
+        // 延后：槽到期时再重新放置
+        node->expires = expires;
+    } else if (node->slot == RUNNING_SLOT) {
+        node->expires = expires;
+    } else {
+        Unlink(node);
+        node->expires = expires;
+        Insert(node);
+    }
+}
+
+void TimingWheel::Cancel(TimerNode *node) {
+    assert(node);
+    if (!node->IsActive()) {
+        return;
+    }
+    Unlink(node);
+    count_--;
+}
+
+// 高层的槽轮转到当前位置时，把其中的节点重新放入低层
+void TimingWheel::Cascade() {
+    for (int level = 1; level < LEVELS; level++) {
+        int shift = L0_BITS + (level - 1) * LN_BITS;
+        int index = (cur_tick_ >> shift) & LN_MASK;
+        TimerNode *head = &slots_[L0_SIZE + (level - 1) * LN_SIZE + index];
+        while (!Empty(head)) {
+            TimerNode *node = head->next;
+            Unlink(node);
+            Insert(node);
+        }
+        if (index != 0) {
+            break;
+        }
+    }
+}
+
+void TimingWheel::RunSlot(int index) {
+    TimerNode *head = &slots_[index];
+    if (Empty(head)) {
+        return;
+    }
+    // 先把整个槽摘到局部链表，重新放置的节点可能落回同一个槽
+    TimerNode running;
+    running.next = head->next;
+    running.prev = head->prev;
+    running.next->prev = &running;
+    running.prev->next = &running;
+    running.slot = RUNNING_SLOT;
+    head->prev = head->next = head;
+    bitmap_[index >> 6] &= ~(1ULL << (index & 63));
+    for (TimerNode *node = running.next; node != &running; node = node->next) {
+        node->slot = RUNNING_SLOT;
+    }
+    // cur_tick_ 已指向下一个 tick
+    int64_t now = (cur_tick_ - 1) * tick_MS_;
+    // 回调可能取消局部链表中的其他节点，每次都从表头取
+    while (!Empty(&running)) {
+        TimerNode *node = running.next;
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+        node->slot = -1;
+        if (node->expires > now) {
+            // 到期时间已被延后
+            Insert(node);
+            continue;
+        }
+        count_--;
+        node->cb(node->arg, node->data);
+    }
+}
+
+void TimingWheel::Tick(int64_t now_MS) {
+    int64_t target = now_MS / tick_MS_;
+    while (cur_tick_ <= target) {
+        if (count_ == 0) {
+            cur_tick_ = target + 1;
+            break;
+        }
+        int index = cur_tick_ & L0_MASK;
+        if (index == 0) {
+            Cascade();
+        }
+        cur_tick_++;
+        RunSlot(index);
+        if (!(bitmap_[0] | bitmap_[1] | bitmap_[2] | bitmap_[3])) {
+            // 第 0 层已空，直接跳到下一次级联
+            int64_t next = (cur_tick_ | L0_MASK) + 1;
+            if ((cur_tick_ & L0_MASK) == 0) {
+                next = cur_tick_;
+            }
+            if (next > target + 1) {
+                next = target + 1;
+            }
+            if (next > cur_tick_) {
+                cur_tick_ = next;
+            }
+        }
+    }
+}
+
+int64_t TimingWheel::NextTickMS() const {
+    if (count_ == 0) {
+        return -1;
+    }
+    int index = cur_tick_ & L0_MASK;
+    if (index == 0) {
+        // 需要先级联
+        return cur_tick_ * tick_MS_;
+    }
+    for (int w = index >> 6; w < L0_SIZE / 64; w++) {
+        uint64_t bits = bitmap_[w];
+        if (w == (index >> 6)) {
+            bits &= ~0ULL << (index & 63);
+        }
+        if (bits) {
+            int slot = w * 64 + __builtin_ctzll(bits);
+            return (cur_tick_ - index + slot) * tick_MS_;
+        }
+    }
+    // 本轮剩余的槽都为空，下一次级联时再看
+    return ((cur_tick_ | L0_MASK) + 1) * tick_MS_;
+}
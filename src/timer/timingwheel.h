@@ -0,0 +1,73 @@
+#ifndef __TIMINGWHEEL_H__
+#define __TIMINGWHEEL_H__
+
+#include "coarseclock.h"
+#include <assert.h>
+#include <stdint.h>
+
+typedef void (*TimeoutCallBack)(void *arg, void *data);
+
+// 侵入式定时器节点，由使用者持有 (例如嵌入 HttpConn)，定时器本身不分配内存
+struct TimerNode {
+    TimerNode *prev = nullptr;
+    TimerNode *next = nullptr;
+    int64_t expires = 0; // 到期时间，CoarseClock::NowMS 的时间基准
+    TimeoutCallBack cb = nullptr;
+    void *arg = nullptr;
+    void *data = nullptr;
+    int slot = -1; // 所在槽位，-1 表示不在定时器中
+    bool IsActive() const { return slot >= 0; }
+};
+
+// 分层时间轮，添加、调整、取消都是 O(1)
+// 第 0 层 256 个槽，每槽一个 tick；第 1~3 层各 64 个槽，
+// 每层跨度是下一层的 64 倍
+// 延后到期时间 (例如每次读写延长连接超时) 只修改节点的 expires，
+// 等节点所在槽到期时再按新的时间重新放置 (惰性到期)
+// 只能在一个线程中使用
+class TimingWheel {
+  public:
+    explicit TimingWheel(int tick_MS = 10);
+    ~TimingWheel();
+    // node 已在定时器中时等同于 Adjust
+    void Add(TimerNode *node, int time_out_MS, TimeoutCallBack cb, void *arg,
+             void *data);
+    void Adjust(TimerNode *node, int time_out_MS);
+    void Cancel(TimerNode *node);
+    // 执行到 now_MS 为止到期的回调，回调中可以添加或取消任意定时器
+    void Tick(int64_t now_MS);
+    // 下一次需要调用 Tick 的时间 (ms)，没有定时器时返回 -1
+    int64_t NextTickMS() const;
+    size_t Size() const { return count_; }
+
+  private:
+    static const int L0_BITS = 8;
+    static const int LN_BITS = 6;
+    static const int L0_SIZE = 1 << L0_BITS;
+    static const int LN_SIZE = 1 << LN_BITS;
+    static const int L0_MASK = L0_SIZE - 1;
+    static const int LN_MASK = LN_SIZE - 1;
+    static const int LEVELS = 4;
+    static const int SLOT_COUNT = L0_SIZE + (LEVELS - 1) * LN_SIZE;
+    // 正在执行的槽中的节点
+    static const int RUNNING_SLOT = SLOT_COUNT;
+    static const int64_t MAX_TICKS = 1LL << (L0_BITS + (LEVELS - 1) * LN_BITS);
+
+    void Insert(TimerNode *node);
+    void Link(TimerNode *node, int slot);
+    void Unlink(TimerNode *node);
+    void Cascade();
+    void RunSlot(int index);
+    bool Empty(const TimerNode *head) const { return head->next == head; }
+
+    int tick_MS_;
+    // 下一个要处理的 tick
+    int64_t cur_tick_;
+    size_t count_;
+    // 每个槽是以哨兵节点为头的双向循环链表
+    TimerNode slots_[SLOT_COUNT];
+    // 第 0 层非空槽的位图，用来找下一次到期的槽
+    uint64_t bitmap_[L0_SIZE / 64];
+};
+
+#endif //__TIMINGWHEEL_H__
@@ -0,0 +1,26 @@
+#ifndef __ALLOCCOUNT_H__
+#define __ALLOCCOUNT_H__
+
+#include <cstdlib>
+#include <new>
+
+#include "check.h"
+
+// 替换全局 operator new，统计本线程的调用次数
+// FileCache 的后台压缩等其他线程的分配不计入
+// 替换函数只能定义一次，每个测试程序只包含这个头文件一次
+static thread_local long alloc_count = 0;
+
+void *operator new(size_t n) {
+    alloc_count++;
+    void *p = malloc(n ? n : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+#endif //__ALLOCCOUNT_H__
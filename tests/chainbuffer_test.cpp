@@ -0,0 +1,164 @@
+// 随机操作 ChainBuffer，每一步都和用 std::string 保存的期望内容比较
+#include "check.h"
+
+#include "../src/buffer/chainbuffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const int STEPS = 50000;
+
+static std::mt19937 rng(12345);
+
+static size_t Rand(size_t n) { return n == 0 ? 0 : rng() % n; }
+
+// 偏向小的长度，偶尔跨越多块
+static size_t RandLen() {
+    switch (Rand(4)) {
+    case 0:
+        return Rand(16);
+    case 1:
+        return Rand(ChainBuffer::BLOCK_SIZE);
+    case 2:
+        return Rand(3 * ChainBuffer::BLOCK_SIZE);
+    default:
+        return Rand(200);
+    }
+}
+
+static void Verify(const ChainBuffer &buff, const std::string &expect) {
+    CHECK(buff.ReadableBytes() == expect.size());
+    if (expect.empty()) {
+        return;
+    }
+    std::string out(expect.size(), '\0');
+    buff.CopyOut(0, &out[0], out.size());
+    CHECK(out == expect);
+    // 按块导出的 iov 覆盖全部数据
+    struct iovec iov[64];
+    int cnt = 0;
+    size_t n = buff.AppendIov(0, expect.size(), iov, &cnt, 64);
+    std::string joined;
+    for (int i = 0; i < cnt; i++) {
+        joined.append(static_cast<char *>(iov[i].iov_base), iov[i].iov_len);
+    }
+    CHECK(n == joined.size());
+    CHECK(joined == expect.substr(0, n));
+}
+
+int main() {
+    ChainBuffer buff;
+    std::string expect;
+    std::string data;
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    // 写出端非阻塞，WriteFd 只写出 socket 放得下的部分
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    for (int step = 0; step < STEPS; step++) {
+        switch (Rand(10)) {
+        case 0:
+        case 1: {
+            data.resize(RandLen());
+            for (char &ch : data) {
+                ch = static_cast<char>('a' + Rand(26));
+            }
+            buff.Append(data);
+            expect += data;
+            break;
+        }
+        case 2: {
+            size_t n = Rand(expect.size() + 1);
+            buff.Retrieve(n);
+            expect.erase(0, n);
+            break;
+        }
+        case 3: {
+            size_t off = Rand(expect.size() + 1);
+            size_t n = Rand(expect.size() - off + 1);
+            buff.Erase(off, n);
+            expect.erase(off, n);
+            break;
+        }
+        case 4: {
+            size_t n = Rand(expect.size() + 1);
+            const char *p = buff.Pullup(n);
+            CHECK(buff.ContiguousBytes() >= n);
+            CHECK(n == 0 || memcmp(p, expect.data(), n) == 0);
+            break;
+        }
+        case 5: {
+            size_t off = Rand(expect.size() + 1);
+            size_t pos = buff.FindCRLF(off);
+            size_t want = expect.find("\r\n", off);
+            CHECK(pos == (want == std::string::npos ? expect.size() : want));
+            // 在随机位置放一个 "\r\n"，经常落在块的边界上
+            data = "\r\n";
+            buff.Append(data);
+            expect += data;
+            break;
+        }
+        case 6: {
+            data.resize(RandLen());
+            for (char &ch : data) {
+                ch = static_cast<char>('A' + Rand(26));
+            }
+            CHECK(write(fds[0], data.data(), data.size()) ==
+                  static_cast<ssize_t>(data.size()));
+            int err = 0;
+            size_t got = 0;
+            while (got < data.size()) {
+                ssize_t n = buff.ReadFd(fds[1], &err);
+                CHECK(n > 0);
+                got += n;
+            }
+            expect += data;
+            break;
+        }
+        case 7: {
+            int err = 0;
+            ssize_t n = buff.WriteFd(fds[0], &err);
+            CHECK(n >= 0 || err == EAGAIN);
+            std::string out(n > 0 ? n : 0, '\0');
+            for (size_t got = 0; got < out.size();) {
+                ssize_t r = read(fds[1], &out[got], out.size() - got);
+                CHECK(r > 0);
+                got += r;
+            }
+            CHECK(out == expect.substr(0, out.size()));
+            expect.erase(0, out.size());
+            break;
+        }
+        case 8:
+            if (Rand(20) == 0) {
+                buff.RetrieveAll();
+                expect.clear();
+            } else if (Rand(20) == 0) {
+                buff.Release();
+                expect.clear();
+                CHECK(buff.Capacity() == 0);
+            }
+            break;
+        default: {
+            buff.EnsureWriteable(1 + Rand(ChainBuffer::BLOCK_SIZE * 2));
+            size_t n = Rand(buff.WriteableBytes() + 1);
+            for (size_t i = 0; i < n; i++) {
+                buff.BeginWrite()[i] = static_cast<char>('0' + Rand(10));
+            }
+            expect.append(buff.BeginWrite(), n);
+            buff.HashWritten(n);
+            break;
+        }
+        }
+        Verify(buff, expect);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    printf("%d steps, %zu bytes left\n", STEPS, expect.size());
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <cstdio>
+#include <cstdlib>
+
+// 条件不成立时打印位置并以失败退出，测试程序在任何构建类型下都检查
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,   \
+                    #cond);                                                    \
+            exit(1);                                                           \
+        }                                                                      \
+    } while (0)
+
+#endif //__CHECK_H__
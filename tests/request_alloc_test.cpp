@@ -0,0 +1,170 @@
+// 预热之后，解析请求并生成响应的整个过程都不应分配内存
+#include "alloccount.h"
+
+#include <cstring>
+#include <string>
+
+#include "../src/http/formdecoder.h"
+#include "../src/http/httprequest.h"
+#include "../src/http/httpresponse.h"
+
+static const int ROUNDS = 1000;
+static const int WARM_UP = 10;
+// 流式表单的字段数，请求体约 100KB，超过内联上限
+static const int FORM_FIELDS = 6000;
+// 模拟每次读到的字节数，和字段、转义的边界都不对齐
+static const size_t READ_SIZE = 1000;
+
+struct Case {
+    const char *name;
+    const char *request;
+    int code;
+};
+
+static const Case CASES[] = {
+    {"browser GET",
+     "GET / HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "Cache-Control: max-age=0\r\n"
+     "sec-ch-ua: \"Chromium\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+     "sec-ch-ua-mobile: ?0\r\n"
+     "sec-ch-ua-platform: \"Linux\"\r\n"
+     "Upgrade-Insecure-Requests: 1\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+     "(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+     "image/avif,image/webp,*/*;q=0.8\r\n"
+     "Sec-Fetch-Site: none\r\n"
+     "Sec-Fetch-Mode: navigate\r\n"
+     "Sec-Fetch-User: ?1\r\n"
+     "Sec-Fetch-Dest: document\r\n"
+     "Accept-Encoding: gzip, deflate, br\r\n"
+     "Accept-Language: en-US,en;q=0.9\r\n"
+     "\r\n",
+     200},
+    {"Range GET",
+     "GET /images/image.jpg HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "Range: bytes=0-99\r\n"
+     "\r\n",
+     206},
+    {"urlencoded POST",
+     "POST /welcome.html HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "Content-Type: application/x-www-form-urlencoded\r\n"
+     "Content-Length: 33\r\n"
+     "\r\n"
+     "name=abc+def&city=x%41yz&q=&e=%7E",
+     200},
+};
+
+// 和 HttpConn::InitResponse 相同的对应关系
+static int Respond(HttpRequest &req, HttpResponse &resp, Buffer &out) {
+    int accept = HttpResponse::AcceptEncoding(
+        req.GetHeader(HttpRequest::HDR_ACCEPT_ENCODING));
+    resp.Init(RESOURCES_DIR, req.Path(), req.IsKeepAlive(), 200, accept);
+    resp.SetConditional(req.GetHeader(HttpRequest::HDR_IF_NONE_MATCH),
+                        req.GetHeader(HttpRequest::HDR_IF_MODIFIED_SINCE));
+    if (req.Method() == "GET") {
+        resp.SetRange(req.GetHeader(HttpRequest::HDR_RANGE),
+                      req.GetHeader(HttpRequest::HDR_IF_RANGE));
+    }
+    resp.MakeResponse(out);
+    resp.ClearFile();
+    return resp.Code();
+}
+
+// 超过内联上限的表单分多次读到，由 FormSink 边读边解码，
+// 缓冲区中只保留头部和最近读到的一段
+static void StreamForm(HttpRequest &req, Buffer &in, bool chunked) {
+    std::string body;
+    char field[64];
+    for (int i = 0; i < FORM_FIELDS; i++) {
+        snprintf(field, sizeof(field), "f%d=a%%41b+c%d&", i, i);
+        body += field;
+    }
+    body += "last=%7E%zz";
+    std::string head = "POST /welcome.html HTTP/1.1\r\n"
+                       "Host: localhost:8080\r\n"
+                       "Connection: keep-alive\r\n"
+                       "Content-Type: application/x-www-form-urlencoded\r\n";
+    if (chunked) {
+        head += "Transfer-Encoding: chunked\r\n\r\n";
+    } else {
+        head += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    }
+    in.Append(head);
+    HttpRequest::PARSE_RESULT ret = req.Pares(in);
+    for (size_t off = 0; off < body.size(); off += READ_SIZE) {
+        CHECK(ret == HttpRequest::PARSE_INCOMPLETE);
+        CHECK(in.ReadableBytes() == head.size());
+        std::string piece = body.substr(off, READ_SIZE);
+        if (chunked) {
+            char size[16];
+            snprintf(size, sizeof(size), "%zx\r\n", piece.size());
+            piece = size + piece + "\r\n";
+        }
+        in.Append(piece);
+        ret = req.Pares(in);
+    }
+    if (chunked) {
+        CHECK(ret == HttpRequest::PARSE_INCOMPLETE);
+        in.Append("0\r\n\r\n");
+        ret = req.Pares(in);
+    }
+    CHECK(ret == HttpRequest::PARSE_COMPLETE);
+    CHECK(req.IsStreaming());
+    CHECK(req.Length() == head.size());
+    CHECK(req.GetPost("f0") == "aAb c0");
+    CHECK(req.GetPost("f4321") == "aAb c4321");
+    CHECK(req.GetPost("f" + std::to_string(FORM_FIELDS - 1)) ==
+          "aAb c" + std::to_string(FORM_FIELDS - 1));
+    // 不合法的转义按原样保留
+    CHECK(req.GetPost("last") == "~%zz");
+    in.Retrieve(req.Length());
+    printf("streamed %s form: %zu bytes\n",
+           chunked ? "chunked" : "Content-Length", body.size());
+}
+
+int main() {
+    FileCache::Instance()->Init(64 << 20, 1000);
+    HttpResponse::LoadErrorPages(RESOURCES_DIR);
+    HttpRequest req;
+    HttpResponse resp;
+    Buffer in, out;
+    for (const Case &c : CASES) {
+        size_t len = strlen(c.request);
+        long allocs = 0;
+        for (int i = 0; i < ROUNDS; i++) {
+            long before = alloc_count;
+            in.Append(c.request, len);
+            CHECK(req.Pares(in) == HttpRequest::PARSE_COMPLETE);
+            CHECK(req.Length() == in.ReadableBytes());
+            CHECK(Respond(req, resp, out) == c.code);
+            in.Retrieve(req.Length());
+            out.RetrieveAll();
+            if (i >= WARM_UP) {
+                allocs += alloc_count - before;
+            }
+        }
+        printf("%-16s allocs: %ld\n", c.name, allocs);
+        CHECK(allocs == 0);
+    }
+    // 请求体的解码结果
+    in.Append(CASES[2].request, strlen(CASES[2].request));
+    CHECK(req.Pares(in) == HttpRequest::PARSE_COMPLETE);
+    CHECK(req.GetPost("name") == "abc def");
+    CHECK(req.GetPost("city") == "xAyz");
+    CHECK(req.GetPost("q") == "");
+    CHECK(req.GetPost("e") == "~");
+    in.Retrieve(req.Length());
+
+    FormSink sink;
+    req.SetBodySink(&sink);
+    StreamForm(req, in, false);
+    StreamForm(req, in, true);
+    return 0;
+}
@@ -0,0 +1,71 @@
+// 预热之后，生成各种状态的响应都不应分配内存
+#include "alloccount.h"
+
+#include <string>
+
+#include "../src/http/httpresponse.h"
+
+static const int ROUNDS = 1000;
+static const int WARM_UP = 10;
+
+struct Case {
+    const char *name;
+    const char *path;
+    const char *range;
+    bool conditional; // 带上 /index.html 的 ETag 作为 If-None-Match
+    int code;
+};
+
+static std::string etag;
+
+static int Make(const Case &c, HttpResponse &resp, Buffer &buff) {
+    resp.Init(RESOURCES_DIR, c.path, true, 200);
+    if (c.conditional) {
+        resp.SetConditional(etag, "");
+    }
+    resp.SetRange(c.range, "");
+    resp.MakeResponse(buff);
+    resp.ClearFile();
+    return resp.Code();
+}
+
+int main() {
+    FileCache::Instance()->Init(64 << 20, 1000);
+    HttpResponse::LoadErrorPages(RESOURCES_DIR);
+    HttpResponse resp;
+    Buffer buff;
+
+    // 先取得 ETag，用于 304
+    Case probe = {"200", "/index.html", "", false, 200};
+    CHECK(Make(probe, resp, buff) == 200);
+    std::string_view head(buff.Pullup(buff.ReadableBytes()),
+                          buff.ReadableBytes());
+    size_t pos = head.find("ETag: ");
+    CHECK(pos != std::string_view::npos);
+    head.remove_prefix(pos + 6);
+    etag = head.substr(0, head.find("\r\n"));
+    buff.RetrieveAll();
+
+    const Case cases[] = {
+        {"200", "/index.html", "", false, 200},
+        {"304", "/index.html", "", true, 304},
+        {"206", "/images/image.jpg", "bytes=0-99", false, 206},
+        {"404", "/nope.html", "", false, 404},
+        {"416", "/index.html", "bytes=999999-", false, 416},
+        {"multipart", "/index.html", "bytes=0-9,20-29,-5", false, 206},
+    };
+    for (const Case &c : cases) {
+        long allocs = 0;
+        for (int i = 0; i < ROUNDS; i++) {
+            long before = alloc_count;
+            CHECK(Make(c, resp, buff) == c.code);
+            if (i >= WARM_UP) {
+                allocs += alloc_count - before;
+            }
+            buff.RetrieveAll();
+        }
+        printf("%-10s allocs: %ld\n", c.name, allocs);
+        CHECK(allocs == 0);
+    }
+    return 0;
+}